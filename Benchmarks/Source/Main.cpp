@@ -0,0 +1,961 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Console benchmarks for the CombFilterBank DSP.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/CombResponse.h"
+
+//==============================================================================
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr size_t blockSize = 512;
+    constexpr size_t numChannels = 2;
+    constexpr int numBlocks = 400;
+
+    // white noise at gain times full scale, the input every benchmark runs on
+    juce::AudioBuffer<float> makeNoise(int channels, int samples, float gain = 1.0f)
+    {
+        juce::AudioBuffer<float> noise(channels, samples);
+        juce::Random random;
+
+        for (int ch = 0; ch < channels; ++ch)
+            for (int i = 0; i < samples; ++i)
+                noise.setSample(ch, i, (random.nextFloat() * 2.0f - 1.0f) * gain);
+
+        return noise;
+    }
+
+    // average nanoseconds per sample frame over numBlocks blocks of noise
+    double timeBank(CombBank& bank, size_t channels = numChannels)
+    {
+        auto input = makeNoise((int) channels, (int) blockSize);
+        juce::AudioBuffer<float> wet((int) channels, (int) blockSize);
+
+        auto run = [&](int blocks)
+        {
+            for (int b = 0; b < blocks; ++b)
+            {
+                wet.clear();
+                bank.process(input.getArrayOfReadPointers(), wet.getArrayOfWritePointers(), channels, blockSize);
+            }
+        };
+
+        run(numBlocks / 10); // warm up caches and branch predictors
+
+        auto start = juce::Time::getHighResolutionTicks();
+        run(numBlocks);
+        auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+        return seconds * 1e9 / (double) (numBlocks * blockSize);
+    }
+
+    void prepareBank(CombBank& bank, size_t numActive, size_t channels = numChannels)
+    {
+        bank.prepare({ sampleRate, (juce::uint32) blockSize, (juce::uint32) channels });
+
+        for (size_t comb = 0; comb < bank.getNumCombs(); ++comb)
+        {
+            bank.setDelay(comb, (float) (100 + comb * 7));
+            bank.setActive(comb, comb < numActive);
+        }
+    }
+
+    //==============================================================================
+    // cost should follow the number of active combs and not the size of the bank
+    void benchmarkActiveScaling()
+    {
+        std::printf("active comb scaling (%zu samples, %zu channels, %.0f Hz)\n", blockSize, numChannels, sampleRate);
+        std::printf("%8s %8s %14s %20s\n", "total", "active", "ns/sample", "ns/comb/sample");
+
+        for (size_t total : { (size_t) 16, (size_t) 128 })
+        {
+            CombBank bank(total);
+
+            for (size_t active : { 1, 2, 4, 8, 16, 32, 64, 128 })
+            {
+                if (active > total) break;
+
+                prepareBank(bank, active);
+                auto ns = timeBank(bank);
+                std::printf("%8zu %8zu %14.2f %20.3f\n", total, active, ns, ns / (double) active);
+            }
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // every channel shares each frame's coefficient loads, so a channel should cost less than a mono bank
+    void benchmarkChannelScaling()
+    {
+        constexpr size_t numActive = 32;
+
+        std::printf("channel scaling (%zu active combs, %zu samples, %.0f Hz)\n", numActive, blockSize, sampleRate);
+        std::printf("%10s %14s %20s %12s\n", "channels", "ns/frame", "ns/channel/frame", "vs mono");
+
+        CombBank bank(numActive);
+        double monoNs = 0.0;
+
+        for (size_t channels : { 1, 2, 6, 8, 16 })
+        {
+            prepareBank(bank, numActive, channels);
+            auto ns = timeBank(bank, channels);
+            if (channels == 1) monoNs = ns;
+            std::printf("%10zu %14.2f %20.2f %11.2fx\n", channels, ns, ns / (double) channels, ns / monoNs);
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // a big ambisonic bank at a small buffer, timed block by block against the buffer's own duration
+    void benchmarkWorkerScaling()
+    {
+        constexpr size_t numActive = 128, channels = CombBank::maxNumChannels, smallBlock = 64;
+        constexpr int numDeadlineBlocks = 4000;
+        const auto deadlineSeconds = (double) smallBlock / sampleRate;
+
+        auto numCores = (size_t) juce::SystemStats::getNumCpus();
+
+        std::printf("worker scaling (%zu active combs, %zu channels, %zu samples, %.1f us deadline, %zu cores)\n",
+                    numActive, channels, smallBlock, deadlineSeconds * 1e6, numCores);
+        std::printf("%10s %14s %10s %12s %14s\n", "threads", "us/block", "speedup", "misses", "worst us");
+
+        auto input = makeNoise((int) channels, (int) smallBlock);
+        juce::AudioBuffer<float> wet((int) channels, (int) smallBlock);
+
+        double serialSeconds = 0.0;
+
+        for (size_t threads = 1; threads <= numCores; ++threads)
+        {
+            WorkerPool pool;
+            pool.start(threads - 1);
+
+            CombBank bank(numActive);
+            bank.setWorkerPool(&pool);
+            bank.prepare({ sampleRate, (juce::uint32) smallBlock, (juce::uint32) channels });
+
+            for (size_t comb = 0; comb < numActive; ++comb)
+            {
+                bank.setDelay(comb, (float) (40 + comb * 7));
+                bank.setActive(comb, true);
+            }
+
+            auto runBlock = [&]
+            {
+                wet.clear();
+                bank.process(input.getArrayOfReadPointers(), wet.getArrayOfWritePointers(), channels, smallBlock);
+            };
+
+            for (int b = 0; b < numDeadlineBlocks / 10; ++b)
+                runBlock();
+
+            double totalSeconds = 0.0, worstSeconds = 0.0;
+            int misses = 0;
+
+            for (int b = 0; b < numDeadlineBlocks; ++b)
+            {
+                auto start = juce::Time::getHighResolutionTicks();
+                runBlock();
+                auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+                totalSeconds += seconds;
+                worstSeconds = juce::jmax(worstSeconds, seconds);
+                if (seconds > deadlineSeconds) ++misses;
+            }
+
+            auto meanSeconds = totalSeconds / numDeadlineBlocks;
+            if (threads == 1) serialSeconds = meanSeconds;
+
+            std::printf("%10zu %14.2f %9.2fx %11.2f%% %14.2f\n", threads, meanSeconds * 1e6, serialSeconds / meanSeconds,
+                        100.0 * misses / numDeadlineBlocks, worstSeconds * 1e6);
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // each saturator against std::tanh over the range the feedback sum actually covers
+    void benchmarkSaturators()
+    {
+        constexpr size_t numValues = 4096;
+        constexpr int numPasses = 2000;
+
+        std::vector<float> source(numValues), work(numValues);
+        juce::Random random;
+        for (auto& v : source) v = random.nextFloat() * 8.0f - 4.0f;
+
+        std::printf("saturators (%zu values x %d passes)\n", numValues, numPasses);
+        std::printf("%10s %12s %10s %14s\n", "type", "ns/value", "speedup", "max error");
+
+        double exactNs = 0.0;
+
+        for (auto [type, name] : { std::pair { Saturator::Type::exact, "exact" },
+                                   std::pair { Saturator::Type::rational, "rational" },
+                                   std::pair { Saturator::Type::table, "table" } })
+        {
+            double maxError = 0.0;
+            std::copy(source.begin(), source.end(), work.begin());
+            Saturator::process(type, work.data(), numValues);
+            for (size_t i = 0; i < numValues; ++i)
+                maxError = juce::jmax(maxError, std::abs((double) work[i] - std::tanh((double) source[i])));
+
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int pass = 0; pass < numPasses; ++pass)
+            {
+                std::copy(source.begin(), source.end(), work.begin());
+                Saturator::process(type, work.data(), numValues);
+            }
+            auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            auto ns = seconds * 1e9 / (double) (numValues * (size_t) numPasses);
+            if (type == Saturator::Type::exact) exactNs = ns;
+            std::printf("%10s %12.3f %9.2fx %14.3g\n", name, ns, exactNs / ns, maxError);
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // a gliding comb splits its tap again every sample in lockstep, so gliding should cost the same
+    // wherever the pitches go, if more than holding still
+    void benchmarkInterpolation()
+    {
+        constexpr size_t numActive = 64;
+
+        std::printf("interpolation (%zu active combs, %zu samples, %.0f Hz)\n", numActive, blockSize, sampleRate);
+        std::printf("%10s %16s %16s\n", "type", "steady ns/frame", "gliding ns/frame");
+
+        auto input = makeNoise((int) numChannels, (int) blockSize);
+        juce::AudioBuffer<float> wet((int) numChannels, (int) blockSize);
+
+        auto pitchFor = [](size_t comb, bool up) { return 110.0f * std::pow(2.0f, (float) comb / 24.0f) * (up ? 1.5f : 1.0f); };
+
+        for (auto [type, name] : { std::pair { FractionalDelay::Type::linear, "linear" },
+                                   std::pair { FractionalDelay::Type::lagrange3, "lagrange3" },
+                                   std::pair { FractionalDelay::Type::thiran, "thiran" } })
+        {
+            CombBank bank(numActive);
+            prepareBank(bank, numActive);
+            bank.setInterpolation(type);
+
+            for (size_t comb = 0; comb < numActive; ++comb)
+                bank.setPitch(comb, pitchFor(comb, false));
+
+            auto steadyNs = timeBank(bank);
+
+            // every comb turns round before it arrives, so each block is one long glide
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                for (size_t comb = 0; comb < numActive; ++comb)
+                    bank.glidePitch(comb, pitchFor(comb, b % 2 == 0), blockSize * 2);
+
+                wet.clear();
+                bank.process(input.getArrayOfReadPointers(), wet.getArrayOfWritePointers(), numChannels, blockSize);
+            }
+            auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            std::printf("%10s %16.2f %16.2f\n", name, steadyNs, seconds * 1e9 / (double) (numBlocks * blockSize));
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // switching tunings live: building a map on the message thread, then retuning every comb on the
+    // audio thread by looking its note up, against working each pitch out with pow() there instead
+    void benchmarkTuning()
+    {
+        constexpr size_t numCombs = 256;
+        constexpr int numSwitches = 2000;
+
+        CombBank bank(numCombs);
+        prepareBank(bank, numCombs);
+
+        // equal temperament and the same a quarter tone up, so every switch moves every comb
+        juce::String scale ("12 equal\n12\n");
+        for (int step = 1; step <= 12; ++step)
+            scale += juce::String(step * 100) + ".0\n";
+
+        Tuning equal, shifted;
+        shifted.loadScala(scale, "0\n0\n127\n60\n69\n452.893\n0\n");
+
+        std::array<NoteDelayMap, 2> maps;
+        auto start = juce::Time::getHighResolutionTicks();
+        for (int i = 0; i < numSwitches; ++i)
+            maps[(size_t) i % 2].build(i % 2 == 0 ? equal : shifted, sampleRate, CombBank::minPitchHz, CombFilterBankAudioProcessor::maxPitchHz);
+        auto buildUs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e6 / numSwitches;
+
+        auto noteFor = [](size_t comb) { return 24 + (int) (comb % 96); };
+
+        start = juce::Time::getHighResolutionTicks();
+        for (int i = 0; i < numSwitches; ++i)
+            for (size_t comb = 0; comb < numCombs; ++comb)
+                bank.glideDelay(comb, maps[(size_t) i % 2].getDelay(noteFor(comb)), blockSize);
+        auto lookupUs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e6 / numSwitches;
+
+        start = juce::Time::getHighResolutionTicks();
+        for (int i = 0; i < numSwitches; ++i)
+        {
+            auto referenceHz = i % 2 == 0 ? 440.0 : 452.893;
+            for (size_t comb = 0; comb < numCombs; ++comb)
+                bank.glidePitch(comb, (float) (referenceHz * std::pow(2.0, (noteFor(comb) - 69) / 12.0)), blockSize);
+        }
+        auto powUs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e6 / numSwitches;
+
+        std::printf("tuning switch (%zu combs, %.0f Hz)\n", numCombs, sampleRate);
+        std::printf("%30s %12s\n", "", "us/switch");
+        std::printf("%30s %12.2f\n", "build map (message thread)", buildUs);
+        std::printf("%30s %12.2f\n", "retune bank by lookup", lookupUs);
+        std::printf("%30s %12.2f\n", "retune bank with pow()", powUs);
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // MIDI Notes on, with more and more note events spread over each block. Every event splits the
+    // block there, so this is the price of sample-accurate notes against a block with none
+    void benchmarkMidiNotes()
+    {
+        constexpr size_t numCombs = 32;
+        constexpr int eventCounts[] { 0, 1, 8, 32, 128 };
+
+        CombFilterBankAudioProcessor processor(numCombs);
+        auto& parameters = processor.getValueTreeState();
+
+        auto setParameter = [&](const juce::String& id, float value)
+        {
+            auto* parameter = parameters.getParameter(id);
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        };
+
+        setParameter("midiNotes", 1.0f);
+        for (size_t comb = 0; comb < numCombs; ++comb)
+            setParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, "Active"), 1.0f);
+
+        processor.setRateAndBufferSizeDetails(sampleRate, (int) blockSize);
+        processor.prepareToPlay(sampleRate, (int) blockSize);
+
+        auto noise = makeNoise((int) numChannels, (int) blockSize, 0.5f);
+        juce::AudioBuffer<float> buffer((int) numChannels, (int) blockSize);
+
+        std::printf("MIDI note events (%zu combs, %zu samples per block)\n", numCombs, blockSize);
+        std::printf("%16s %12s %12s\n", "events/block", "ns/sample", "us/event");
+
+        auto baseline = 0.0;
+
+        for (auto numEvents : eventCounts)
+        {
+            // note-ons and note-offs in turn, walking up three octaves so each one retunes a comb
+            juce::MidiBuffer midi;
+            for (int e = 0; e < numEvents; ++e)
+            {
+                auto note = 48 + (e / 2) % 36;
+                auto position = e * (int) blockSize / numEvents;
+                midi.addEvent(e % 2 == 0 ? juce::MidiMessage::noteOn(1, note, 0.8f) : juce::MidiMessage::noteOff(1, note), position);
+            }
+
+            auto run = [&](int blocks)
+            {
+                for (int b = 0; b < blocks; ++b)
+                {
+                    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                        buffer.copyFrom(ch, 0, noise, ch, 0, (int) blockSize);
+
+                    processor.processBlock(buffer, midi);
+                }
+            };
+
+            run(numBlocks / 10);
+
+            auto start = juce::Time::getHighResolutionTicks();
+            run(numBlocks);
+            auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            auto nsPerSample = seconds * 1e9 / (double) (numBlocks * blockSize);
+            if (numEvents == 0)
+            {
+                baseline = nsPerSample;
+                std::printf("%16d %12.2f %12s\n", numEvents, nsPerSample, "-");
+            }
+            else
+                std::printf("%16d %12.2f %12.3f\n", numEvents, nsPerSample, (nsPerSample - baseline) * (double) blockSize / numEvents / 1000.0);
+        }
+
+        processor.releaseResources();
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // the processor at shrinking host buffers, held still and with the wet mix automated every block.
+    // The control work runs on its own grid, so the cost per sample should stay flat down to the
+    // control interval and only climb below it
+    void benchmarkHostBlockSizes()
+    {
+        constexpr size_t numCombs = 32;
+        constexpr int totalSamples = numBlocks * (int) blockSize;
+
+        CombFilterBankAudioProcessor processor(numCombs);
+        auto* wet = processor.getValueTreeState().getParameter("wet");
+
+        for (size_t comb = 0; comb < numCombs; ++comb)
+            processor.getValueTreeState().getParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, "Active"))->setValueNotifyingHost(1.0f);
+
+        std::printf("host block sizes (%zu combs, %zu sample control interval)\n", numCombs, CombFilterBankAudioProcessor::controlInterval);
+        std::printf("%12s %14s %14s\n", "samples", "steady ns", "automated ns");
+
+        for (int hostBlock : { 1, 4, 16, 32, 64, 256, 1024 })
+        {
+            processor.setRateAndBufferSizeDetails(sampleRate, hostBlock);
+            processor.prepareToPlay(sampleRate, hostBlock);
+
+            auto noise = makeNoise((int) numChannels, hostBlock, 0.5f);
+            juce::AudioBuffer<float> buffer((int) numChannels, hostBlock);
+            juce::MidiBuffer midi;
+
+            auto time = [&](bool automate)
+            {
+                auto start = juce::Time::getHighResolutionTicks();
+
+                for (int done = 0; done < totalSamples; done += hostBlock)
+                {
+                    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                        buffer.copyFrom(ch, 0, noise, ch, 0, hostBlock);
+
+                    if (automate)
+                        wet->setValueNotifyingHost((float) (done / hostBlock % 100) * 0.01f);
+
+                    processor.processBlock(buffer, midi);
+                }
+
+                return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e9 / totalSamples;
+            };
+
+            time(false); // warm up
+            auto steadyNs = time(false);
+            auto automatedNs = time(true);
+            wet->setValueNotifyingHost(0.5f);
+
+            std::printf("%12d %14.2f %14.2f\n", hostBlock, steadyNs, automatedNs);
+            processor.releaseResources();
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // the processor at high host rates with the bank at the host rate and decimated. Each second of
+    // audio should cost about as much decimated at 96 or 192 kHz as it does at 48 kHz, plus the
+    // resamplers, where at the host rate it grows with the rate
+    void benchmarkDecimation()
+    {
+        constexpr size_t numCombs = 32;
+        constexpr int seconds = 2;
+
+        CombFilterBankAudioProcessor processor(numCombs);
+
+        for (size_t comb = 0; comb < numCombs; ++comb)
+            processor.getValueTreeState().getParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, "Active"))->setValueNotifyingHost(1.0f);
+
+        std::printf("decimation (%zu combs, %zu sample blocks)\n", numCombs, blockSize);
+        std::printf("%12s %8s %16s %10s\n", "host rate", "factor", "ms per second", "latency");
+
+        for (double hostRate : { 48000.0, 96000.0, 192000.0 })
+        {
+            for (bool decimate : { false, true })
+            {
+                if (decimate && BankDecimator::getFactorFor(hostRate) == 1) continue;
+
+                processor.setDecimationMode(decimate);
+                processor.setRateAndBufferSizeDetails(hostRate, (int) blockSize);
+                processor.prepareToPlay(hostRate, (int) blockSize);
+
+                auto noise = makeNoise((int) numChannels, (int) blockSize, 0.5f);
+                juce::AudioBuffer<float> buffer((int) numChannels, (int) blockSize);
+                juce::MidiBuffer midi;
+
+                auto totalSamples = (int) hostRate * seconds;
+
+                auto time = [&]
+                {
+                    auto start = juce::Time::getHighResolutionTicks();
+
+                    for (int done = 0; done < totalSamples; done += (int) blockSize)
+                    {
+                        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                            buffer.copyFrom(ch, 0, noise, ch, 0, (int) blockSize);
+
+                        processor.processBlock(buffer, midi);
+                    }
+
+                    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e3 / seconds;
+                };
+
+                time(); // warm up
+                std::printf("%12.0f %8zu %16.2f %10d\n", hostRate, processor.getDecimationFactor(), time(), processor.getLatencySamples());
+                processor.releaseResources();
+            }
+        }
+
+        processor.setDecimationMode(false);
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // a burst of noise then silence, with feedback spread across the bank so the combs die away one
+    // by one. The cost of each stretch should follow how many combs are still awake
+    void benchmarkSleep()
+    {
+        constexpr size_t numCombs = 64;
+        constexpr int blocksPerStretch = 25; // about a quarter of a second each
+
+        CombBank bank(numCombs);
+        bank.prepare({ sampleRate, (juce::uint32) blockSize, (juce::uint32) numChannels });
+
+        for (size_t comb = 0; comb < numCombs; ++comb)
+        {
+            bank.setDelay(comb, (float) (40 + comb * 41));
+            bank.setFeedback(comb, 0.2f + 0.79f * (float) comb / (float) (numCombs - 1));
+            bank.setActive(comb, true);
+        }
+
+        auto noise = makeNoise((int) numChannels, (int) blockSize);
+        juce::AudioBuffer<float> silence((int) numChannels, (int) blockSize), wet((int) numChannels, (int) blockSize);
+        silence.clear();
+
+        std::printf("sleeping combs (%zu combs, feedback 0.2 to 0.99, %zu-sample blocks)\n", numCombs, blockSize);
+        std::printf("%10s %12s %12s\n", "seconds", "awake", "ns/frame");
+
+        for (int stretch = 0; stretch < 24; ++stretch)
+        {
+            auto& input = stretch == 0 ? noise : silence;
+            size_t awake = 0;
+
+            auto start = juce::Time::getHighResolutionTicks();
+            for (int b = 0; b < blocksPerStretch; ++b)
+            {
+                wet.clear();
+                bank.process(input.getArrayOfReadPointers(), wet.getArrayOfWritePointers(), numChannels, blockSize);
+                awake += bank.getNumAwakeCombs();
+            }
+            auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            std::printf("%10.2f %12.1f %12.1f\n", (double) (stretch * blocksPerStretch) * blockSize / sampleRate,
+                        (double) awake / blocksPerStretch, seconds * 1e9 / (double) (blocksPerStretch * blockSize));
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // a static bank against its own impulse response, through processBlock() so the convolution is
+    // handed the same pieces of the control grid it gets in a host. The tails are short enough to be
+    // captured, and the noise quiet enough to stay linear
+    void benchmarkConvolution()
+    {
+        constexpr int numBlocks = 200;
+        auto settleBlocks = (int) std::ceil(CombFilterBankAudioProcessor::settleSeconds * sampleRate / (double) blockSize) + 2;
+
+        auto noise = makeNoise((int) numChannels, (int) blockSize, 0.01f);
+        juce::AudioBuffer<float> buffer((int) numChannels, (int) blockSize);
+        juce::MidiBuffer midi;
+
+        std::printf("static bank as a convolution (feedback 0.2 to 0.6, %zu-sample blocks, overhead %zu combs)\n",
+                    blockSize, BankConvolver::getOverheadCombs(CombFilterBankAudioProcessor::controlInterval));
+        std::printf("%10s %14s %14s\n", "combs", "combs ns/fr", "conv ns/fr");
+
+        for (auto numCombs : { (size_t) 32, (size_t) 64, (size_t) 128, (size_t) 256 })
+        {
+            CombFilterBankAudioProcessor processor(numCombs);
+            auto& parameters = processor.getValueTreeState();
+
+            auto setParameter = [&] (size_t comb, const juce::String& name, float value)
+            {
+                auto* parameter = parameters.getParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, name));
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+            };
+
+            for (size_t comb = 0; comb < numCombs; ++comb)
+            {
+                setParameter(comb, "Pitch", (float) (sampleRate / (double) (40 + comb * 440 / numCombs)));
+                setParameter(comb, "Feedback", 0.2f + 0.4f * (float) comb / (float) (numCombs - 1));
+                setParameter(comb, "Active", 1.0f);
+            }
+
+            // the capture runs in line, so the convolution is ready as soon as the bank has settled
+            processor.setNonRealtime(true);
+
+            auto run = [&] (int blocks)
+            {
+                for (int b = 0; b < blocks; ++b)
+                {
+                    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                        buffer.copyFrom(ch, 0, noise, ch, 0, (int) blockSize);
+
+                    processor.processBlock(buffer, midi);
+                }
+            };
+
+            auto time = [&] (bool convolve)
+            {
+                processor.setConvolutionMode(convolve);
+                processor.setRateAndBufferSizeDetails(sampleRate, (int) blockSize);
+                processor.prepareToPlay(sampleRate, (int) blockSize);
+
+                // long enough for the settings to count as settled and for the combs' own tails to
+                // run out once the convolution has the input
+                run(settleBlocks * 2);
+
+                auto start = juce::Time::getHighResolutionTicks();
+                run(numBlocks);
+                auto ns = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start)
+                            * 1e9 / (double) (numBlocks * blockSize);
+
+                auto convolving = processor.isConvolving();
+                processor.releaseResources();
+                return std::make_pair(ns, convolving);
+            };
+
+            auto combNs = time(false).first;
+            auto [convolutionNs, convolving] = time(true);
+
+            if (convolving)
+                std::printf("%10zu %14.1f %14.1f\n", numCombs, combNs, convolutionNs);
+            else
+                std::printf("%10zu %14.1f %14s\n", numCombs, combNs, "turned down");
+        }
+
+        std::printf("\n");
+    }
+
+    //==============================================================================
+    // dragging one comb's knob should cost one comb's curve, not the whole bank's
+    void benchmarkCombResponse()
+    {
+        constexpr size_t numCombs = 64;
+        constexpr int numUpdates = 2000;
+        constexpr double frameMicroseconds = 1e6 / 60.0;
+
+        CombResponse response(numCombs);
+        response.setSampleRate(sampleRate);
+
+        for (size_t comb = 0; comb < numCombs; ++comb)
+            response.setComb(comb, { 55.0f + (float) comb * 13.0f, 0.8f, 0.25f, CombBank::defaultDampingHz, true });
+
+        std::array<float, CombResponse::numPoints> decibels;
+
+        auto start = juce::Time::getHighResolutionTicks();
+        for (int update = 0; update < numUpdates; ++update)
+        {
+            response.setComb(5, { 120.0f, 0.5f + 0.4f * (float) (update % 97) / 97.0f, 0.25f, CombBank::defaultDampingHz, true });
+            response.getOutputDecibels(decibels.data(), 0.5f, 1.0f, -48.0f);
+        }
+        auto incremental = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e6 / numUpdates;
+
+        start = juce::Time::getHighResolutionTicks();
+        for (int update = 0; update < numUpdates / 20; ++update)
+        {
+            response.setSampleRate(update % 2 == 0 ? sampleRate * 2.0 : sampleRate);
+            response.getOutputDecibels(decibels.data(), 0.5f, 1.0f, -48.0f);
+        }
+        auto full = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1e6 / (numUpdates / 20);
+
+        std::printf("comb response (%zu combs, %d points)\n", numCombs, CombResponse::numPoints);
+        std::printf("%22s %12s %14s\n", "", "us/update", "% of 60 fps");
+        std::printf("%22s %12.2f %13.2f%%\n", "one comb changed", incremental, 100.0 * incremental / frameMicroseconds);
+        std::printf("%22s %12.2f %13.2f%%\n", "whole bank recomputed", full, 100.0 * full / frameMicroseconds);
+        std::printf("\n");
+    }
+}
+
+//==============================================================================
+// The sweep times three layers of the same work across every combination of bank size, block
+// size, sample rate and channel count, and writes the lot as JSON so runs from two commits can
+// be diffed. Each layer adds something on top of the one before:
+//   kernel     one scalar DelayLine and DampingFilter per comb and channel, the textbook comb
+//   bank       CombBank::process(), packed into SIMD lanes
+//   processor  CombFilterBankAudioProcessor::processBlock(), with the gains and wet mix
+namespace sweep
+{
+    constexpr size_t activeCounts[]   { 1, 8, 32, 128 };
+    constexpr int blockSizes[]        { 16, 64, 256, 1024, 4096 };
+    constexpr double sampleRates[]    { 44100.0, 96000.0, 192000.0 };
+    constexpr int channelCounts[]     { 1, 2, 6, 16 };
+
+    constexpr size_t maxActive = 128;
+    constexpr int minBlocks = 32; // so even the longest blocks give the 99th percentile something to work with
+
+    struct Config
+    {
+        size_t numActive;
+        int blockSize;
+        double sampleRate;
+        int numChannels;
+    };
+
+    // spread over five octaves from A1, so longer banks reach the shorter delays too
+    float pitchFor(size_t comb) noexcept
+    {
+        return 55.0f * std::pow(2.0f, (float) comb / 24.0f);
+    }
+
+    //==============================================================================
+    /** Runs processBlock() repeatedly over noise and reports per-block statistics as a JSON object. */
+    template <typename ProcessBlock>
+    juce::var measure(const char* target, const Config& config, int framesPerConfig, ProcessBlock&& processBlock)
+    {
+        auto numBlocks = juce::jmax(minBlocks, framesPerConfig / config.blockSize);
+
+        auto noise = makeNoise(config.numChannels, config.blockSize, 0.5f);
+        juce::AudioBuffer<float> buffer (config.numChannels, config.blockSize);
+
+        // processing in place overwrites the input, so each block starts from a fresh copy
+        auto runBlock = [&]
+        {
+            for (int ch = 0; ch < config.numChannels; ++ch)
+                buffer.copyFrom(ch, 0, noise, ch, 0, config.blockSize);
+
+            processBlock(buffer);
+        };
+
+        for (int b = 0; b < numBlocks / 10 + 1; ++b)
+            runBlock();
+
+        std::vector<double> blockSeconds ((size_t) numBlocks);
+
+        for (auto& seconds : blockSeconds)
+        {
+            auto start = juce::Time::getHighResolutionTicks();
+            runBlock();
+            seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        }
+
+        auto totalSeconds = std::accumulate(blockSeconds.begin(), blockSeconds.end(), 0.0);
+        auto totalFrames = (double) numBlocks * config.blockSize;
+
+        std::sort(blockSeconds.begin(), blockSeconds.end());
+        auto p99 = blockSeconds[(size_t) std::ceil(0.99 * numBlocks) - 1];
+        auto nsPerSample = totalSeconds * 1e9 / totalFrames;
+        auto realTimeFactor = totalFrames / config.sampleRate / totalSeconds;
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty("target", target);
+        result->setProperty("activeCombs", (int) config.numActive);
+        result->setProperty("blockSize", config.blockSize);
+        result->setProperty("sampleRate", config.sampleRate);
+        result->setProperty("channels", config.numChannels);
+        result->setProperty("blocks", numBlocks);
+        result->setProperty("nsPerSample", nsPerSample);
+        result->setProperty("nsPerChannelSample", nsPerSample / config.numChannels);
+        result->setProperty("realTimeFactor", realTimeFactor);
+        result->setProperty("meanBlockUs", totalSeconds * 1e6 / numBlocks);
+        result->setProperty("p99BlockUs", p99 * 1e6);
+        result->setProperty("worstBlockUs", blockSeconds.back() * 1e6);
+
+        std::fprintf(stderr, "%-10s %4zu combs %5d samples %6.0f Hz %3d ch  %9.2f ns/sample  %8.1fx real time\n",
+                     target, config.numActive, config.blockSize, config.sampleRate, config.numChannels, nsPerSample, realTimeFactor);
+
+        return juce::var(result);
+    }
+
+    //==============================================================================
+    juce::var measureKernel(const Config& config, int framesPerConfig)
+    {
+        struct Comb
+        {
+            DelayLine line;
+            size_t delay;
+            float state = 0.0f;
+        };
+
+        auto coefficient = DampingFilter::coefficientFor(CombBank::defaultDampingHz, config.sampleRate);
+        auto capacity = DelayLine::capacityFor((size_t) std::ceil(config.sampleRate / CombBank::minPitchHz));
+        auto numLines = config.numActive * (size_t) config.numChannels;
+
+        std::vector<float> storage (numLines * capacity);
+        std::vector<Comb> combs (numLines);
+
+        for (size_t i = 0; i < numLines; ++i)
+        {
+            combs[i].line.setStorage(storage.data() + i * capacity, capacity);
+            combs[i].delay = (size_t) juce::roundToInt(config.sampleRate / pitchFor(i / (size_t) config.numChannels));
+        }
+
+        std::vector<float> wet ((size_t) config.blockSize);
+
+        return measure("kernel", config, framesPerConfig, [&] (juce::AudioBuffer<float>& buffer)
+        {
+            for (int ch = 0; ch < config.numChannels; ++ch)
+            {
+                auto* io = buffer.getWritePointer(ch);
+                std::fill(wet.begin(), wet.end(), 0.0f);
+
+                for (size_t comb = 0; comb < config.numActive; ++comb)
+                {
+                    auto& c = combs[comb * (size_t) config.numChannels + (size_t) ch];
+
+                    for (int i = 0; i < config.blockSize; ++i)
+                    {
+                        auto delayed = c.line.get(c.delay);
+                        auto damped = DampingFilter::processSample(delayed, c.state, coefficient);
+                        c.line.push(io[i] + 0.5f * damped);
+                        wet[(size_t) i] += 0.25f * delayed;
+                    }
+                }
+
+                juce::FloatVectorOperations::copy(io, wet.data(), config.blockSize);
+            }
+        });
+    }
+
+    juce::var measureBank(const Config& config, int framesPerConfig)
+    {
+        CombBank bank (config.numActive);
+        bank.prepare({ config.sampleRate, (juce::uint32) config.blockSize, (juce::uint32) config.numChannels });
+
+        for (size_t comb = 0; comb < config.numActive; ++comb)
+        {
+            bank.setPitch(comb, pitchFor(comb));
+            bank.setActive(comb, true);
+        }
+
+        juce::AudioBuffer<float> wet (config.numChannels, config.blockSize);
+
+        return measure("bank", config, framesPerConfig, [&] (juce::AudioBuffer<float>& buffer)
+        {
+            wet.clear();
+            bank.process(buffer.getArrayOfReadPointers(), wet.getArrayOfWritePointers(), (size_t) config.numChannels, (size_t) config.blockSize);
+        });
+    }
+
+    juce::var measureProcessor(CombFilterBankAudioProcessor& processor, const Config& config, int framesPerConfig)
+    {
+        auto& parameters = processor.getValueTreeState();
+
+        auto setParameter = [&] (size_t comb, const juce::String& name, float value)
+        {
+            auto* parameter = parameters.getParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, name));
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        };
+
+        for (size_t comb = 0; comb < processor.getNumParameterCombs(); ++comb)
+        {
+            setParameter(comb, "Pitch", pitchFor(comb));
+            setParameter(comb, "Active", comb < config.numActive ? 1.0f : 0.0f);
+        }
+
+        processor.setRateAndBufferSizeDetails(config.sampleRate, config.blockSize);
+        processor.prepareToPlay(config.sampleRate, config.blockSize);
+
+        juce::MidiBuffer midi;
+
+        auto result = measure("processor", config, framesPerConfig, [&] (juce::AudioBuffer<float>& buffer)
+        {
+            processor.processBlock(buffer, midi);
+        });
+
+        processor.releaseResources();
+        return result;
+    }
+
+    juce::var run(int framesPerConfig)
+    {
+        juce::Array<juce::var> results;
+
+        CombFilterBankAudioProcessor processor (maxActive);
+
+        for (auto numChannels : channelCounts)
+        {
+            juce::AudioProcessor::BusesLayout layout;
+            layout.inputBuses.add(CombFilterBankAudioProcessor::getChannelSetFor(numChannels));
+            layout.outputBuses.add(CombFilterBankAudioProcessor::getChannelSetFor(numChannels));
+            processor.setBusesLayout(layout);
+
+            for (auto sampleRate : sampleRates)
+                for (auto blockSize : blockSizes)
+                    for (auto numActive : activeCounts)
+                    {
+                        Config config { numActive, blockSize, sampleRate, numChannels };
+                        results.add(measureKernel(config, framesPerConfig));
+                        results.add(measureBank(config, framesPerConfig));
+                        results.add(measureProcessor(processor, config, framesPerConfig));
+                    }
+        }
+
+        auto* root = new juce::DynamicObject();
+        root->setProperty("cpu", juce::SystemStats::getCpuModel());
+        root->setProperty("cores", juce::SystemStats::getNumCpus());
+        root->setProperty("simdLanes", (int) CombBank::laneWidth);
+        root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+        root->setProperty("framesPerConfig", framesPerConfig);
+        root->setProperty("results", results);
+
+        return juce::var(root);
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // the processor's parameter state expects a message manager to exist, even with no GUI
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::File jsonFile;
+    auto sweepOnly = false;
+    auto framesPerConfig = 16384;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg (argv[i]);
+        auto next = [&] { return i + 1 < argc ? juce::String(argv[++i]) : juce::String(); };
+
+        if      (arg == "--json")   jsonFile = juce::File::getCurrentWorkingDirectory().getChildFile(next());
+        else if (arg == "--sweep")  sweepOnly = true;
+        else if (arg == "--frames") framesPerConfig = juce::jmax(1, next().getIntValue());
+        else
+        {
+            std::printf("usage: CombFilterBankBenchmarks [--sweep] [--json <file>] [--frames <n>]\n"
+                        "  with no options prints the tables, --sweep prints the sweep's JSON instead,\n"
+                        "  --json writes it to a file and --frames sets how much audio each configuration runs\n");
+            return 1;
+        }
+    }
+
+    if (! sweepOnly && jsonFile == juce::File())
+    {
+        benchmarkActiveScaling();
+        benchmarkChannelScaling();
+        benchmarkWorkerScaling();
+        benchmarkSaturators();
+        benchmarkInterpolation();
+        benchmarkTuning();
+        benchmarkMidiNotes();
+        benchmarkHostBlockSizes();
+        benchmarkDecimation();
+        benchmarkSleep();
+        benchmarkConvolution();
+        benchmarkCombResponse();
+        return 0;
+    }
+
+    auto json = juce::JSON::toString(sweep::run(framesPerConfig));
+
+    if (jsonFile == juce::File())
+    {
+        std::printf("%s\n", json.toRawUTF8());
+    }
+    else if (! jsonFile.replaceWithText(json))
+    {
+        std::printf("can't write %s\n", jsonFile.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,354 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Offline renderer that runs audio files through CombFilterBankAudioProcessor.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+
+//==============================================================================
+namespace
+{
+    struct RenderSettings
+    {
+        juce::File outputDirectory;          // empty writes next to each input
+        juce::String suffix { "-comb" };
+        size_t numCombs = CombBank::defaultNumCombs;
+        int blockSize = 512;                 // what processBlock() sees, as a host would hand it
+        int readBlockSize = 65536;           // what the reader and writer move at a time
+        double tailSeconds = 0.0;            // silence appended so the combs can ring out
+        bool convolution = false;            // hand a static bank over to its impulse response
+        bool decimate = false;               // run the bank at a lower rate for 88.2 kHz and up
+        juce::MemoryBlock state;             // the preset, in the form getStateInformation() writes
+    };
+
+    // print from any job without the lines running into each other
+    juce::CriticalSection printLock;
+
+    void print(const juce::String& line)
+    {
+        const juce::ScopedLock sl(printLock);
+        std::printf("%s\n", line.toRawUTF8());
+        std::fflush(stdout);
+    }
+
+    //==============================================================================
+    /** Reads a preset into the processor: either the XML state the plugin saves, or plain
+        "parameterID = value" lines in the parameter's own units, with # starting a comment.
+    */
+    juce::String loadPreset(CombFilterBankAudioProcessor& processor, const juce::File& file)
+    {
+        if (! file.existsAsFile())
+            return "can't find preset " + file.getFullPathName();
+
+        if (auto xml = juce::parseXML(file))
+        {
+            juce::MemoryBlock state;
+            juce::AudioProcessor::copyXmlToBinary(*xml, state);
+            processor.setStateInformation(state.getData(), (int) state.getSize());
+            return {};
+        }
+
+        juce::StringArray lines;
+        file.readLines(lines);
+
+        for (auto line : lines)
+        {
+            line = line.upToFirstOccurrenceOf("#", false, false).trim();
+            if (line.isEmpty()) continue;
+
+            auto id = line.upToFirstOccurrenceOf("=", false, false).trim();
+            auto* parameter = processor.getValueTreeState().getParameter(id);
+
+            if (parameter == nullptr)
+                return "unknown parameter \"" + id + "\" in " + file.getFileName();
+
+            auto value = line.fromFirstOccurrenceOf("=", false, false).trim().getFloatValue();
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        }
+
+        return {};
+    }
+
+    //==============================================================================
+    /** Streams one file through the processor. Returns an error message, or nothing on success. */
+    juce::String renderFile(CombFilterBankAudioProcessor& processor, juce::AudioFormatManager& formats,
+                            juce::TimeSliceThread& writerThread, const juce::File& input, const RenderSettings& settings,
+                            double& audioSeconds)
+    {
+        auto* format = formats.findFormatForFileExtension(input.getFileExtension());
+        if (format == nullptr)
+            return "not a format the renderer reads";
+
+        // mapping the whole file lets the OS page it in as fast as it can, falling back to
+        // ordinary reads for anything that can't be mapped
+        std::unique_ptr<juce::AudioFormatReader> reader;
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader(input));
+
+        if (mapped != nullptr && mapped->mapEntireFile())
+            reader = std::move(mapped);
+        else
+            reader.reset(formats.createReaderFor(input));
+
+        if (reader == nullptr)
+            return "can't read file";
+
+        auto numChannels = (int) reader->numChannels;
+        auto channelSet = CombFilterBankAudioProcessor::getChannelSetFor(numChannels);
+
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+
+        if (channelSet.isDisabled() || ! processor.setBusesLayout(layout))
+            return "unsupported channel count " + juce::String(numChannels);
+
+        auto outputFile = (settings.outputDirectory == juce::File() ? input.getParentDirectory() : settings.outputDirectory)
+                              .getChildFile(input.getFileNameWithoutExtension() + settings.suffix + input.getFileExtension());
+
+        // an empty suffix into the input's own folder would delete the file while it is still being read
+        if (outputFile == input)
+            return "the output would overwrite the input";
+
+        outputFile.deleteFile();
+        auto stream = outputFile.createOutputStream();
+        if (stream == nullptr)
+            return "can't write " + outputFile.getFullPathName();
+
+        auto bitsPerSample = reader->usesFloatingPointData ? 32 : (int) reader->bitsPerSample;
+        auto* writer = format->createWriterFor(stream.get(), reader->sampleRate, (unsigned int) numChannels,
+                                               bitsPerSample, reader->metadataValues, 0);
+        if (writer == nullptr)
+            return "can't create a " + format->getFormatName() + " writer";
+
+        stream.release(); // the writer owns it now
+
+        // the writer thread does the encoding and disk writes while this one keeps processing
+        juce::AudioFormatWriter::ThreadedWriter threadedWriter (writer, writerThread, 4 * settings.readBlockSize);
+
+        processor.setRateAndBufferSizeDetails(reader->sampleRate, settings.blockSize);
+        processor.prepareToPlay(reader->sampleRate, settings.blockSize);
+
+        // the output runs late by the latency, so that much more is processed and the start dropped,
+        // which lines the rendered file up with the input the way a host would
+        auto latency = (juce::int64) processor.getLatencySamples();
+        auto inputLength = reader->lengthInSamples;
+        auto totalLength = inputLength + (juce::int64) (settings.tailSeconds * reader->sampleRate) + latency;
+        audioSeconds = (double) (totalLength - latency) / reader->sampleRate;
+
+        juce::AudioBuffer<float> buffer (numChannels, settings.readBlockSize);
+        juce::MidiBuffer midi;
+
+        for (juce::int64 position = 0; position < totalLength; position += settings.readBlockSize)
+        {
+            auto numSamples = (int) juce::jmin((juce::int64) settings.readBlockSize, totalLength - position);
+            auto numToRead = (int) juce::jlimit((juce::int64) 0, (juce::int64) numSamples, inputLength - position);
+
+            buffer.clear();
+            if (numToRead > 0)
+                reader->read(&buffer, 0, numToRead, position, true, true);
+
+            for (int start = 0; start < numSamples; start += settings.blockSize)
+            {
+                juce::AudioBuffer<float> block (buffer.getArrayOfWritePointers(), numChannels, start,
+                                                juce::jmin(settings.blockSize, numSamples - start));
+                processor.processBlock(block, midi);
+            }
+
+            auto numToSkip = (int) juce::jlimit((juce::int64) 0, (juce::int64) numSamples, latency - position);
+            if (numToSkip == numSamples) continue;
+
+            juce::AudioBuffer<float> output (buffer.getArrayOfWritePointers(), numChannels, numToSkip, numSamples - numToSkip);
+
+            // the fifo only fills up if the disk falls behind, so wait for it rather than drop audio
+            while (! threadedWriter.write(output.getArrayOfReadPointers(), output.getNumSamples()))
+                juce::Thread::sleep(1);
+        }
+
+        processor.releaseResources();
+        return {};
+    }
+
+    //==============================================================================
+    /** Takes files off the shared list until there are none left, each with its own processor. */
+    class RenderJob : public juce::ThreadPoolJob
+    {
+    public:
+        RenderJob(CombFilterBankAudioProcessor& p, const juce::Array<juce::File>& inputFiles,
+                  std::atomic<int>& next, std::atomic<int>& failed, const RenderSettings& s)
+            : juce::ThreadPoolJob("Render"),
+              processor(p), files(inputFiles), nextFile(next), numFailed(failed), settings(s)
+        {
+        }
+
+        JobStatus runJob() override
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+
+            juce::TimeSliceThread writerThread ("Render writer");
+            writerThread.startThread();
+
+            for (auto index = nextFile++; index < files.size() && ! shouldExit(); index = nextFile++)
+            {
+                auto& file = files.getReference(index);
+                auto start = juce::Time::getMillisecondCounterHiRes();
+                auto audioSeconds = 0.0;
+                auto error = renderFile(processor, formats, writerThread, file, settings, audioSeconds);
+                auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) * 0.001;
+
+                if (error.isNotEmpty())
+                {
+                    ++numFailed;
+                    print(file.getFullPathName() + ": " + error);
+                }
+                else
+                {
+                    print(file.getFullPathName() + ": " + juce::String(seconds, 2) + " s, "
+                          + juce::String(audioSeconds / seconds, 1) + "x real time");
+                }
+            }
+
+            writerThread.stopThread(5000);
+            return jobHasFinished;
+        }
+
+    private:
+        CombFilterBankAudioProcessor& processor;
+        const juce::Array<juce::File>& files;
+        std::atomic<int>& nextFile;
+        std::atomic<int>& numFailed;
+        const RenderSettings& settings;
+    };
+
+    void printUsage()
+    {
+        std::printf("usage: CombFilterBankRenderer [options] <file or directory>...\n"
+                    "  --preset <file>     plugin state XML, or \"parameterID = value\" lines\n"
+                    "  --combs <n>         combs in the bank, to match the preset (default %zu)\n"
+                    "  --out <directory>   where rendered files go (default next to each input)\n"
+                    "  --suffix <text>     added to each rendered file's name (default -comb)\n"
+                    "  --jobs <n>          files rendered at once (default one per core)\n"
+                    "  --block <n>         samples per processBlock() call (default 512)\n"
+                    "  --tail <seconds>    silence appended so the combs can ring out (default 0)\n"
+                    "  --convolution       run the bank as a convolution while its settings hold still\n"
+                    "  --decimate          run the bank at 44.1 or 48 kHz behind resamplers at higher rates\n",
+                    CombBank::defaultNumCombs);
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    // the processor's parameter state expects a message manager to exist, even with no GUI
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    RenderSettings settings;
+    juce::File presetFile;
+    auto numJobs = juce::SystemStats::getNumCpus();
+    juce::Array<juce::File> files, folderFiles;
+
+    auto cwd = juce::File::getCurrentWorkingDirectory();
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg (argv[i]);
+        auto next = [&] { return i + 1 < argc ? juce::String(argv[++i]) : juce::String(); };
+
+        if      (arg == "--preset") presetFile = cwd.getChildFile(next());
+        else if (arg == "--combs")  settings.numCombs = (size_t) juce::jlimit(1, (int) CombBank::maxNumCombs, next().getIntValue());
+        else if (arg == "--out")    settings.outputDirectory = cwd.getChildFile(next());
+        else if (arg == "--suffix") settings.suffix = next();
+        else if (arg == "--jobs")   numJobs = juce::jmax(1, next().getIntValue());
+        else if (arg == "--block")  settings.blockSize = juce::jlimit(16, settings.readBlockSize, next().getIntValue());
+        else if (arg == "--tail")   settings.tailSeconds = juce::jmax(0.0, next().getDoubleValue());
+        else if (arg == "--convolution") settings.convolution = true;
+        else if (arg == "--decimate")    settings.decimate = true;
+        else if (arg.startsWith("-"))
+        {
+            printUsage();
+            return 1;
+        }
+        else
+        {
+            auto file = cwd.getChildFile(arg);
+
+            if (file.isDirectory())
+                folderFiles.addArray(file.findChildFiles(juce::File::findFiles, false, "*.wav;*.aif;*.aiff"));
+            else
+                files.add(file);
+        }
+    }
+
+    // renders left in a folder by an earlier run would otherwise come back with the suffix twice.
+    // The suffix may come after the folder, so this waits until every option has been read
+    for (auto& file : folderFiles)
+        if (settings.suffix.isEmpty() || ! file.getFileNameWithoutExtension().endsWith(settings.suffix))
+            files.add(file);
+
+    if (files.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (settings.outputDirectory != juce::File() && ! settings.outputDirectory.createDirectory())
+    {
+        std::printf("can't create %s\n", settings.outputDirectory.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    // every job starts from the same state, so the preset is parsed once here and copied across
+    numJobs = juce::jmin(numJobs, files.size());
+    juce::OwnedArray<CombFilterBankAudioProcessor> processors;
+
+    for (int job = 0; job < numJobs; ++job)
+    {
+        auto* processor = processors.add(new CombFilterBankAudioProcessor(settings.numCombs));
+        processor->setNonRealtime(true);
+        processor->setConvolutionMode(settings.convolution);
+        processor->setDecimationMode(settings.decimate);
+
+        if (job == 0)
+        {
+            if (presetFile != juce::File())
+            {
+                auto error = loadPreset(*processor, presetFile);
+                if (error.isNotEmpty())
+                {
+                    std::printf("%s\n", error.toRawUTF8());
+                    return 1;
+                }
+            }
+
+            processor->getStateInformation(settings.state);
+        }
+        else
+        {
+            processor->setStateInformation(settings.state.getData(), (int) settings.state.getSize());
+        }
+    }
+
+    std::atomic<int> nextFile { 0 }, numFailed { 0 };
+    auto start = juce::Time::getMillisecondCounterHiRes();
+
+    {
+        juce::ThreadPool pool (numJobs);
+
+        for (auto* processor : processors)
+            pool.addJob(new RenderJob(*processor, files, nextFile, numFailed, settings), true);
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep(50);
+    }
+
+    auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) * 0.001;
+    print("rendered " + juce::String(files.size() - numFailed.load()) + " of " + juce::String(files.size())
+          + " files in " + juce::String(seconds, 2) + " s using " + juce::String(numJobs) + " jobs");
+
+    return numFailed.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+/*
+  ==============================================================================
+
+    BankConvolver.cpp
+
+  ==============================================================================
+*/
+
+#include "BankConvolver.h"
+
+//==============================================================================
+class BankConvolver::CaptureThread : public juce::Thread
+{
+public:
+    explicit CaptureThread(BankConvolver& c) : juce::Thread("Comb impulse capture"), owner(c) {}
+
+    // polled rather than notified, since signalling an event from the audio thread would lock
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            auto expected = CaptureState::requested;
+            if (owner.state.compare_exchange_strong(expected, CaptureState::capturing, std::memory_order_acquire))
+                owner.capture();
+            else
+                wait(20);
+        }
+    }
+
+private:
+    BankConvolver& owner;
+};
+
+//==============================================================================
+BankConvolver::BankConvolver() = default;
+
+BankConvolver::~BankConvolver()
+{
+    release();
+}
+
+void BankConvolver::prepare(double sampleRate, size_t callSize, size_t numChannels, size_t numCombs)
+{
+    release();
+    overheadCombs = getOverheadCombs(callSize);
+
+    for (auto& slot : slots)
+    {
+        slot.impulse.allocate(partitionSize, maxPartitions);
+        slot.valid = false;
+    }
+
+    convolution.prepare(partitionSize, maxPartitions, numChannels);
+
+    requestedCombs.assign(numCombs, {});
+    response.assign(maxPartitions * partitionSize, 0.0f);
+    auto longestReach = (int) std::ceil(sampleRate / CombBank::minPitchHz) + (int) FractionalDelay::maxReadsPastDelay + 1;
+    line.assign((size_t) juce::nextPowerOfTwo(longestReach), 0.0f);
+
+    activeSlot = 0;
+    waitingSlot = -1;
+    running = false;
+    samplesSinceInput = tailSamples = 0;
+    state = CaptureState::idle;
+
+    thread = std::make_unique<CaptureThread>(*this);
+    thread->startThread();
+    prepared = true;
+}
+
+void BankConvolver::release()
+{
+    if (thread != nullptr)
+        thread->stopThread(1000);
+
+    thread.reset();
+    prepared = false;
+    running = false;
+    samplesSinceInput = tailSamples = 0;
+}
+
+size_t BankConvolver::getOverheadCombs(size_t callSize) noexcept
+{
+    // rough multiply-adds per sample and channel. A comb's interpolation, damping and feedback come
+    // to about combCost, and a call into FloatVectorOperations to about callCost before its first sample
+    constexpr double combCost = 12.0, callCost = 4.0;
+
+    auto shortSize = (double) PartitionedConvolution::shortPartitionSize;
+    auto size = (double) partitionSize;
+
+    // a forward and an inverse transform of twice the block, once per block, and a complex
+    // multiply-add per bin for each partition
+    auto transformCost = [] (double blockSize) { return 2.0 * std::log2(2.0 * blockSize); };
+    auto partitionCost = [] (double blockSize) { return 4.0 * (blockSize + 1.0) / blockSize; };
+
+    auto head = shortSize + callCost * shortSize / (double) juce::jmax(callSize, (size_t) 1);
+    auto shortPartitions = (size / shortSize - 1.0) * partitionCost(shortSize);
+    auto total = head + shortPartitions + transformCost(shortSize) + transformCost(size);
+
+    return (size_t) std::ceil(total / combCost);
+}
+
+//==============================================================================
+bool BankConvolver::requestCapture(const CombBank& bank, juce::uint32 generation, bool waitForIt) noexcept
+{
+    collectCapture();
+
+    if (state.load(std::memory_order_acquire) != CaptureState::idle) return false;
+
+    // whatever was waiting is for older settings, and its slot is about to be reused
+    waitingSlot = -1;
+
+    if (bank.getNumActiveCombs() <= overheadCombs) return true;
+
+    for (size_t comb = 0; comb < requestedCombs.size(); ++comb)
+    {
+        auto& c = requestedCombs[comb];
+        c.active = comb < bank.getNumCombs() && bank.isActive(comb);
+        if (! c.active) continue;
+
+        c.delay = bank.getDelay(comb);
+        c.feedback = bank.getFeedback(comb);
+        c.level = bank.getLevel(comb);
+        c.damping = bank.getDampingCoefficient(comb);
+    }
+
+    requestedInterpolation = bank.getInterpolation();
+    requestedGeneration = generation;
+    targetSlot = 1 - activeSlot;
+
+    if (waitForIt)
+    {
+        state.store(CaptureState::capturing, std::memory_order_relaxed);
+        capture();
+        collectCapture();
+    }
+    else
+    {
+        state.store(CaptureState::requested, std::memory_order_release);
+    }
+
+    return true;
+}
+
+void BankConvolver::collectCapture() noexcept
+{
+    if (state.load(std::memory_order_acquire) != CaptureState::finished) return;
+
+    if (slots[targetSlot].valid)
+        waitingSlot = (int) targetSlot;
+
+    state.store(CaptureState::idle, std::memory_order_release);
+}
+
+bool BankConvolver::hasImpulseFor(juce::uint32 generation) noexcept
+{
+    collectCapture();
+
+    if (waitingSlot >= 0)
+        return slots[(size_t) waitingSlot].generation == generation;
+
+    // one that was stopped by loud input can start again once it has rung out
+    return slots[activeSlot].valid && slots[activeSlot].generation == generation;
+}
+
+bool BankConvolver::isLinearFor(float inputPeak) const noexcept
+{
+    auto& slot = running || waitingSlot < 0 ? slots[activeSlot] : slots[(size_t) waitingSlot];
+    return inputPeak * slot.lineGain <= linearLimit;
+}
+
+bool BankConvolver::start() noexcept
+{
+    if (running) return true;
+    if (isRinging()) return false;
+
+    if (waitingSlot >= 0)
+    {
+        activeSlot = (size_t) waitingSlot;
+        waitingSlot = -1;
+    }
+
+    if (! slots[activeSlot].valid) return false;
+
+    auto& impulse = slots[activeSlot].impulse;
+    convolution.reset(impulse.getNumPartitions());
+
+    // the last input sample reaches the end of the impulse a partition after it went in
+    tailSamples = (impulse.getNumPartitions() + 1) * impulse.getPartitionSize();
+    samplesSinceInput = 0;
+    running = true;
+    return true;
+}
+
+//==============================================================================
+void BankConvolver::process(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    if (! running && ! isRinging()) return;
+
+    convolution.process(slots[activeSlot].impulse, running ? input : nullptr, wet, numChannels, numSamples);
+
+    // silent input counts towards the tail running out, so a quiet stretch can skip the convolution
+    auto inputPeak = 0.0f;
+    if (running)
+    {
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax(input[ch], (int) numSamples);
+            inputPeak = juce::jmax(inputPeak, -range.getStart(), range.getEnd());
+        }
+    }
+
+    samplesSinceInput = inputPeak > CombBank::sleepThreshold ? 0 : juce::jmin(samplesSinceInput + numSamples, tailSamples);
+}
+
+//==============================================================================
+void BankConvolver::capture() noexcept
+{
+    auto& slot = slots[targetSlot];
+    slot.valid = false;
+    slot.generation = requestedGeneration;
+
+    size_t numActive = 0;
+    auto maxFeedback = 0.0f;
+
+    for (auto& c : requestedCombs)
+    {
+        if (! c.active) continue;
+
+        ++numActive;
+        maxFeedback = juce::jmax(maxFeedback, c.feedback);
+    }
+
+    // a comb at full feedback never decays, so it is turned down below before this matters
+    slot.lineGain = maxFeedback < 1.0f ? 1.0f / (1.0f - maxFeedback) : std::numeric_limits<float>::max();
+
+    // past this many partitions the combs would have been cheaper
+    auto affordable = numActive > overheadCombs ? juce::jmin(maxPartitions, numActive - overheadCombs) : 0;
+
+    if (auto length = renderImpulse(affordable * partitionSize); length > 0)
+        slot.valid = slot.impulse.set(response.data(), length);
+
+    state.store(CaptureState::finished, std::memory_order_release);
+}
+
+size_t BankConvolver::renderImpulse(size_t maxLength) noexcept
+{
+    if (maxLength == 0) return 0;
+
+    std::fill_n(response.begin(), maxLength, 0.0f);
+    size_t length = 0;
+
+    for (auto& c : requestedCombs)
+    {
+        if (! c.active || c.level == 0.0f) continue;
+
+        using Type = FractionalDelay::Type;
+        size_t n = 0;
+
+        switch (requestedInterpolation)
+        {
+            case Type::linear:    n = renderComb<Type::linear>(c, maxLength); break;
+            case Type::lagrange3: n = renderComb<Type::lagrange3>(c, maxLength); break;
+            case Type::thiran:    n = renderComb<Type::thiran>(c, maxLength); break;
+        }
+
+        // a comb that rings for longer than the convolution can afford keeps the bank on the combs
+        if (n == maxLength) return 0;
+
+        length = juce::jmax(length, n + 1);
+    }
+
+    return length;
+}
+
+template <FractionalDelay::Type InterpolationType>
+size_t BankConvolver::renderComb(const CombSettings& c, size_t maxLength) noexcept
+{
+    constexpr auto numReads = FractionalDelay::numReads<InterpolationType>;
+
+    auto split = FractionalDelay::split<InterpolationType>(c.delay);
+    auto blend = FractionalDelay::coefficientFor<InterpolationType>(split.fraction);
+    auto nearest = split.tap - FractionalDelay::readsBeforeTap<InterpolationType>;
+    auto reach = nearest + numReads - 1;
+    auto mask = line.size() - 1;
+
+    std::fill(line.begin(), line.end(), 0.0f);
+    auto filterState = 0.0f, interpolatorState = 0.0f;
+    size_t quiet = 0, n = 0;
+
+    // the bank's loop without the saturator: line[n] = x[n] + feedback * damped(interpolated line)
+    for (; n < maxLength; ++n)
+    {
+        float reads[numReads];
+        for (size_t k = 0; k < numReads; ++k)
+            reads[k] = line[(n - nearest - k) & mask];
+
+        auto interpolated = FractionalDelay::interpolate<InterpolationType>(reads, blend, interpolatorState);
+        auto delayed = DampingFilter::processSample(interpolated, filterState, c.damping);
+
+        auto& written = line[n & mask];
+        written = (n == 0 ? 1.0f : 0.0f) + c.feedback * delayed;
+        response[n] += c.level * delayed;
+
+        // once everything the taps reach and both filters are under the threshold, nothing louder can
+        // come out again. The first pass is skipped, since the impulse hasn't come out yet
+        auto isQuiet = std::abs(written) < CombBank::sleepThreshold && std::abs(filterState) < CombBank::sleepThreshold
+                    && std::abs(interpolatorState) < CombBank::sleepThreshold;
+        quiet = isQuiet ? quiet + 1 : 0;
+
+        if (n > reach && quiet >= reach)
+            break;
+    }
+
+    return n;
+}
@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    BankConvolver.h
+    Runs a bank whose settings hold still as one convolution with its captured impulse response.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CombBank.h"
+#include "PartitionedConvolution.h"
+
+//==============================================================================
+/**
+    Apart from the saturator the bank is linear and time-invariant while nothing moves, so its
+    whole output is the input convolved with one impulse response. The same holds for any number
+    of combs, so past a few dozen combs one partitioned convolution costs less than the combs do.
+
+    The response is worked out on a background thread from a copy of the bank's settings. Each comb
+    runs as a plain linear recurrence, reading its line with the bank's interpolation, until everything
+    its taps can reach has stayed under CombBank::sleepThreshold. A capture is turned down when the
+    response would need more partitions than the bank has active combs less getOverheadCombs(),
+    because the convolution would then cost more than the combs.
+
+    The saturator is left out, which only holds while the lines stay small. isLinearFor() bounds
+    them the way TailTracker does, by the input peak over 1 - feedback of the comb that feeds back
+    most. Under linearLimit the curve bends by well under a percent.
+
+    Switching over never touches what either side is already holding. Once the convolution starts,
+    new input goes to it and the bank is fed silence, so the bank's tail rings out through the
+    combs and they drop off to sleep. When something moves, stop() sends new input back to the bank
+    and the convolution is fed silence until its tail has run out. Both tails are exactly what
+    would have come out of one engine, so the handover is a crossfade with nothing to click.
+
+    The capture thread and the audio thread hand the work back and forth through one atomic state,
+    and each impulse slot is only written while the audio thread isn't reading it. Nothing locks,
+    and nothing allocates after prepare().
+*/
+class BankConvolver
+{
+public:
+    static constexpr size_t maxPartitions = 256;
+
+    // a longer partition reaches further with the same ring, but the first one is split into more
+    // short partitions, all of which run however short the calls are
+    static constexpr size_t partitionSize = 1024;
+
+    // the loudest the lines may get, by the bound above, before the saturator is audible
+    static constexpr float linearLimit = 0.1f; // -20 dBFS
+
+    BankConvolver();
+    ~BankConvolver();
+
+    /** Allocates both impulse slots and the convolution's history and starts the capture thread.
+        callSize is the longest piece process() will be handed, which sets what the convolution
+        costs before its impulse. Call from prepareToPlay(), never while processing.
+    */
+    void prepare(double sampleRate, size_t callSize, size_t numChannels, size_t numCombs);
+
+    /** Stops the capture thread and frees everything, leaving the bank to do all the work. */
+    void release();
+    bool isPrepared() const noexcept { return prepared; }
+
+    /** About how many combs the head, the short partitions and the transforms cost, however long the
+        impulse is, for calls of callSize samples. The head's taps each start again on every call,
+        so shorter calls cost more.
+    */
+    static size_t getOverheadCombs(size_t callSize) noexcept;
+    size_t getOverheadCombs() const noexcept { return overheadCombs; }
+
+    //==============================================================================
+    /** Copies the bank's settings and asks for their impulse response, tagged with generation.
+        With waitForIt the capture runs on the calling thread before this returns, for offline
+        rendering where the result mustn't depend on how fast the background thread is.
+
+        Returns false only if a capture is already under way. A bank too small to gain anything
+        from a convolution is turned down without one.
+    */
+    bool requestCapture(const CombBank& bank, juce::uint32 generation, bool waitForIt = false) noexcept;
+
+    /** Whether an impulse for this generation has been captured and is waiting or running. */
+    bool hasImpulseFor(juce::uint32 generation) noexcept;
+
+    /** Whether input peaking here keeps every line of the captured settings under linearLimit. */
+    bool isLinearFor(float inputPeak) const noexcept;
+
+    /** Sends new input to the convolution with the impulse hasImpulseFor() found, or with the one
+        it last ran if nothing newer has been captured. Returns false while the convolution is still
+        ringing out, which it has to finish first.
+    */
+    bool start() noexcept;
+
+    /** Sends new input back to the bank while everything the convolution already has rings out. */
+    void stop() noexcept { running = false; }
+    bool isRunning() const noexcept { return running; }
+
+    /** How long the impulse running, or last run, is. */
+    size_t getNumPartitions() const noexcept { return slots[activeSlot].impulse.getNumPartitions(); }
+
+    /** Whether the convolution could still put out anything above CombBank::sleepThreshold. */
+    bool isRinging() const noexcept { return samplesSinceInput < tailSamples; }
+
+    /** Adds the convolution's output into wet. While running it takes the input, otherwise it only
+        rings out what it has. Does nothing once that has run out.
+    */
+    void process(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+private:
+    class CaptureThread;
+
+    enum class CaptureState
+    {
+        idle,       // the audio thread may write a request
+        requested,  // the capture thread may take it
+        capturing,  // the capture thread owns the request and the target slot
+        finished    // the audio thread may read the result
+    };
+
+    struct CombSettings
+    {
+        float delay = FractionalDelay::minDelay;
+        float feedback = 0.0f, level = 0.0f, damping = 1.0f;
+        bool active = false;
+    };
+
+    struct Slot
+    {
+        PartitionedConvolution::Impulse impulse;
+        juce::uint32 generation = 0;
+        float lineGain = 1.0f;
+        bool valid = false;
+    };
+
+    /** Runs on whichever thread took the request. */
+    void capture() noexcept;
+    size_t renderImpulse(size_t maxLength) noexcept;
+
+    /** Adds one comb's response into response and returns where it went quiet, or maxLength if it didn't. */
+    template <FractionalDelay::Type InterpolationType>
+    size_t renderComb(const CombSettings& comb, size_t maxLength) noexcept;
+    void collectCapture() noexcept;
+
+    bool prepared = false;
+    size_t overheadCombs = 0;
+    std::unique_ptr<CaptureThread> thread;
+    std::atomic<CaptureState> state { CaptureState::idle };
+
+    // written by the audio thread before a request, read by the capture thread after it
+    std::vector<CombSettings> requestedCombs;
+    FractionalDelay::Type requestedInterpolation = FractionalDelay::Type::lagrange3;
+    juce::uint32 requestedGeneration = 0;
+    size_t targetSlot = 0;
+
+    // the capture thread's own scratch, sized in prepare() so a capture allocates nothing.
+    // line is a power of two long so the recurrence can wrap it with a mask
+    std::vector<float> response, line;
+
+    // the audio thread's side. activeSlot is the one the convolution reads, waitingSlot the one
+    // captured for it to start on next, if any
+    std::array<Slot, 2> slots;
+    size_t activeSlot = 0;
+    int waitingSlot = -1;
+    bool running = false;
+    size_t samplesSinceInput = 0, tailSamples = 0;
+
+    PartitionedConvolution convolution;
+
+    JUCE_DECLARE_NON_COPYABLE(BankConvolver)
+};
@@ -0,0 +1,302 @@
+/*
+  ==============================================================================
+
+    BankDecimator.cpp
+
+  ==============================================================================
+*/
+
+#include "BankDecimator.h"
+
+//==============================================================================
+// one halving, as a linear-phase FIR with its own history on every channel. Only the taps that
+// aren't zero are kept, which for a half-band filter is every other one and the centre
+class BankDecimator::Stage
+{
+public:
+    Stage(const juce::dsp::FIR::Coefficients<float>& coefficients, size_t numChannels)
+        : centre(coefficients.getFilterOrder() / 2)
+    {
+        auto* h = coefficients.getRawCoefficients();
+        auto length = coefficients.getFilterOrder() + 1;
+
+        // odd, so the delay through it is a whole number of samples
+        jassert(length % 2 == 1);
+
+        // going down each output is sum h[k] x[n - k]. Going up, a zero goes between every input
+        // sample and the gain is doubled to make up for them, so each output phase only meets every
+        // other tap
+        for (size_t k = 0; k < length; ++k)
+        {
+            if (h[k] == 0.0f) continue;
+
+            downTaps.push_back({ k + 1, h[k] });
+            upTaps[k % 2].push_back({ k / 2 + 1, 2.0f * h[k] });
+        }
+
+        // going up only half of it is used, since the history is at the lower rate
+        auto capacity = DelayLine::capacityFor(length);
+        storage.allocate(capacity * numChannels, true);
+        history.resize(numChannels);
+
+        for (size_t channel = 0; channel < numChannels; ++channel)
+            history[channel].setStorage(storage.get() + channel * capacity, capacity);
+    }
+
+    /** How many samples at its higher rate the filter delays by. */
+    size_t getCentre() const noexcept { return centre; }
+
+    /** numOutput samples from twice as many input samples. Each is worked out once the second of
+        its pair has arrived.
+    */
+    void decimate(const float* const* input, float* const* output, size_t numChannels, size_t numOutput) noexcept
+    {
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            auto& line = history[channel];
+            auto* in = input[channel];
+            auto* out = output[channel];
+
+            for (size_t i = 0; i < numOutput; ++i)
+            {
+                line.push(in[2 * i]);
+                line.push(in[2 * i + 1]);
+                out[i] = sum(line, downTaps);
+            }
+        }
+    }
+
+    /** Twice numInput samples of output, the even phase first. */
+    void interpolate(const float* const* input, float* const* output, size_t numChannels, size_t numInput) noexcept
+    {
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            auto& line = history[channel];
+            auto* in = input[channel];
+            auto* out = output[channel];
+
+            for (size_t i = 0; i < numInput; ++i)
+            {
+                line.push(in[i]);
+                out[2 * i] = sum(line, upTaps[0]);
+                out[2 * i + 1] = sum(line, upTaps[1]);
+            }
+        }
+    }
+
+private:
+    struct Tap
+    {
+        size_t delay;
+        float weight;
+    };
+
+    static float sum(const DelayLine& line, const std::vector<Tap>& taps) noexcept
+    {
+        auto total = 0.0f;
+        for (auto& tap : taps)
+            total += tap.weight * line.get(tap.delay);
+
+        return total;
+    }
+
+    size_t centre;
+    std::vector<Tap> downTaps;
+    std::array<std::vector<Tap>, 2> upTaps;
+
+    juce::HeapBlock<float> storage;
+    std::vector<DelayLine> history;
+};
+
+//==============================================================================
+BankDecimator::BankDecimator() = default;
+BankDecimator::~BankDecimator() = default;
+
+size_t BankDecimator::getFactorFor(double hostSampleRate) noexcept
+{
+    size_t factor = 1;
+    while (factor < maxFactor && hostSampleRate / (double) (factor * 2) >= minInternalRate)
+        factor *= 2;
+
+    return factor;
+}
+
+void BankDecimator::prepare(double hostSampleRate, size_t maxBlockSize, size_t numChannels)
+{
+    release();
+
+    factor = getFactorFor(hostSampleRate);
+    internalRate = hostSampleRate / (double) factor;
+    if (factor == 1) return;
+
+    // whatever is waiting can make up one more internal sample with the next block
+    maxInternalBlockSize = (maxBlockSize + factor - 1) / factor;
+
+    // indexed by distance from the internal rate. The nearest stage keeps everything up to about
+    // 18 kHz. Further out, the audible band is a smaller and smaller part of what a stage passes,
+    // so its transition can be wider
+    constexpr float transitionWidths[] = { 0.1f, 0.25f, 0.35f };
+    constexpr float stopbandDecibels = -90.0f;
+
+    auto numStages = (size_t) juce::roundToInt(std::log2((double) factor));
+    jassert(numStages <= std::size(transitionWidths));
+
+    // the wet goes out factor - 1 samples late to cover the carry. On top of that, a stage k
+    // halvings from the host rate delays by its centre going each way, at 2^k host samples a sample,
+    // less the one sample going down that comes from working each output out on the second of its pair
+    latencySamples = (int) factor - 1;
+
+    for (size_t k = 0; k < numStages; ++k)
+    {
+        auto coefficients = juce::dsp::FilterDesign<float>::designFIRLowpassHalfBandEquirippleMethod(transitionWidths[numStages - 1 - k],
+                                                                                                      stopbandDecibels);
+        downStages.add(new Stage(*coefficients, numChannels));
+        upStages.insert(0, new Stage(*coefficients, numChannels));
+
+        latencySamples += (int) ((2 * downStages.getLast()->getCentre() - 1) << k);
+    }
+
+    pendingInput.setSize((int) numChannels, (int) (maxBlockSize + factor));
+    pendingWet.setSize((int) numChannels, (int) (maxBlockSize + 2 * factor));
+    pendingInput.clear();
+    pendingWet.clear();
+    numPendingInput = 0;
+    numPendingWet = factor - 1;
+
+    // between stages, never more than a block of host samples
+    for (auto& scratch : stageScratch)
+        scratch.setSize((int) numChannels, (int) (maxBlockSize + factor));
+
+    pendingWetTargets.resize(numChannels);
+
+    internalInput.setSize((int) numChannels, (int) maxInternalBlockSize);
+    internalWet.setSize((int) numChannels, (int) maxInternalBlockSize);
+    internalInput.clear();
+
+    // a whole piece is written before it is read back, so the line holds the latency and a block
+    auto capacity = DelayLine::capacityFor((size_t) latencySamples + maxBlockSize);
+    dryStorage.allocate(capacity * numChannels, true);
+    dryLines.resize(numChannels);
+
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        dryLines[channel].setStorage(dryStorage.get() + channel * capacity, capacity);
+}
+
+void BankDecimator::release()
+{
+    downStages.clear();
+    upStages.clear();
+
+    factor = 1;
+    maxInternalBlockSize = 0;
+    internalRate = 0.0;
+    latencySamples = 0;
+
+    pendingInput.setSize(0, 0);
+    pendingWet.setSize(0, 0);
+    internalInput.setSize(0, 0);
+    internalWet.setSize(0, 0);
+    numPendingInput = numPendingWet = 0;
+
+    for (auto& scratch : stageScratch)
+        scratch.setSize(0, 0);
+
+    pendingWetTargets.clear();
+
+    dryLines.clear();
+    dryStorage.free();
+}
+
+//==============================================================================
+void BankDecimator::delayDry(juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept
+{
+    if (! isActive()) return;
+
+    auto numChannels = juce::jmin((size_t) buffer.getNumChannels(), dryLines.size());
+
+    for (size_t channel = 0; channel < numChannels; ++channel)
+    {
+        auto* io = buffer.getWritePointer((int) channel, (int) start);
+        auto& line = dryLines[channel];
+
+        // the piece goes in whole first, so the read can reach back past its start
+        line.write(io, numSamples);
+        line.read((size_t) latencySamples + numSamples, io, numSamples);
+    }
+}
+
+void BankDecimator::pushInput(const float* const* input, size_t numChannels, size_t numSamples) noexcept
+{
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy(pendingInput.getWritePointer((int) channel, (int) numPendingInput), input[channel], (int) numSamples);
+
+    numPendingInput += numSamples;
+}
+
+void BankDecimator::decimate(size_t numChannels, size_t numInternal) noexcept
+{
+    auto numHost = numInternal * factor;
+
+    // the stages take turns with the scratch, and the last one writes straight to the bank's input
+    auto* source = pendingInput.getArrayOfReadPointers();
+    auto numOutput = numHost;
+
+    for (int k = 0; k < downStages.size(); ++k)
+    {
+        numOutput /= 2;
+        auto* destination = k == downStages.size() - 1 ? internalInput.getArrayOfWritePointers()
+                                                        : stageScratch[(size_t) k % 2].getArrayOfWritePointers();
+
+        downStages.getUnchecked(k)->decimate(source, destination, numChannels, numOutput);
+        source = destination;
+    }
+
+    // fewer than factor samples are left over, and at least factor were taken, so they never overlap
+    numPendingInput -= numHost;
+
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy(pendingInput.getWritePointer((int) channel), pendingInput.getReadPointer((int) channel, (int) numHost), (int) numPendingInput);
+
+    // the bank adds into it
+    internalWet.clear(0, (int) numInternal);
+}
+
+void BankDecimator::interpolate(size_t numChannels, size_t numInternal) noexcept
+{
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        pendingWetTargets[channel] = pendingWet.getWritePointer((int) channel, (int) numPendingWet);
+
+    // the last stage goes straight onto the end of what is waiting to go out
+    auto* source = internalWet.getArrayOfReadPointers();
+    auto numInput = numInternal;
+
+    for (int k = 0; k < upStages.size(); ++k)
+    {
+        auto* destination = k == upStages.size() - 1 ? pendingWetTargets.data()
+                                                      : stageScratch[(size_t) k % 2].getArrayOfWritePointers();
+
+        upStages.getUnchecked(k)->interpolate(source, destination, numChannels, numInput);
+        source = destination;
+        numInput *= 2;
+    }
+
+    numPendingWet += numInternal * factor;
+}
+
+void BankDecimator::popWet(float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    // there are always at least numSamples waiting, since the input side holds fewer than factor
+    jassert(numPendingWet >= numSamples);
+
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy(wet[channel], pendingWet.getReadPointer((int) channel), (int) numSamples);
+
+    numPendingWet -= numSamples;
+
+    // what is left can overlap where it goes when the block is shorter than the factor
+    for (size_t channel = 0; channel < numChannels; ++channel)
+    {
+        auto* row = pendingWet.getWritePointer((int) channel);
+        std::memmove(row, row + numSamples, numPendingWet * sizeof(float));
+    }
+}
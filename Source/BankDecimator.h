@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    BankDecimator.h
+    Runs the bank at a lower internal rate behind half-band resamplers at high host rates.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DelayLine.h"
+
+//==============================================================================
+/**
+    At 96 or 192 kHz every comb needs two or four times the delay memory and the work of a comb at
+    48 kHz, for content that is nearly all below 20 kHz. This brings the input down by the largest
+    power of two that keeps the internal rate at minInternalRate or above, hands the bank each block
+    at that rate, and brings its wet output back up.
+
+    Each direction is a cascade of linear-phase half-band FIR stages, one per halving, designed
+    with FilterDesign's equiripple method. Going down, a stage only works out the samples it keeps,
+    and going up only the taps that meet a real sample, so nearly half the taps are skipped either
+    way. The stage next to the internal rate is the one that has to be sharp. The stages further out
+    only have to keep their images out of the audible band, so they get wider transitions and
+    far fewer taps.
+
+    juce::dsp::Oversampling can't be run in reverse to do this. It only goes up first and then down:
+    processSamplesDown() reads back what processSamplesUp() left in its own buffer, and has no way
+    to be handed a lower-rate block from outside. So the stages here use the same FilterDesign
+    half-bands it does, run the other way round.
+
+    The bank only ever sees whole internal samples, so host samples that don't fill one wait for
+    the next block. The wet output goes out a constant factor - 1 samples later to cover them, on
+    top of the filters' own latency, and the dry signal is delayed to match. getLatencySamples() is
+    the total, for the host to compensate.
+
+    With a factor of 1 nothing is resampled and none of it runs. Nothing allocates after prepare().
+*/
+class BankDecimator
+{
+public:
+    static constexpr double minInternalRate = 44100.0;
+    static constexpr size_t maxFactor = 8;
+
+    /** The power of two the bank's rate is divided by at this host rate, 1 at 48 kHz or below. */
+    static size_t getFactorFor(double hostSampleRate) noexcept;
+
+    BankDecimator();
+    ~BankDecimator();
+
+    /** Allocates the resamplers, the waiting samples and the dry delay. Call from prepareToPlay(),
+        never while processing.
+    */
+    void prepare(double hostSampleRate, size_t maxBlockSize, size_t numChannels);
+
+    /** Frees everything, leaving the bank at the host rate. */
+    void release();
+
+    bool isActive() const noexcept { return factor > 1; }
+    size_t getFactor() const noexcept { return factor; }
+    double getInternalRate() const noexcept { return internalRate; }
+
+    /** The most internal samples one call to process() hands the bank. */
+    size_t getMaxInternalBlockSize() const noexcept { return maxInternalBlockSize; }
+
+    /** How many host samples the wet and dry paths run behind the input. */
+    int getLatencySamples() const noexcept { return latencySamples; }
+
+    //==============================================================================
+    /** Decimates numSamples of input and calls runBank(input, wet, numInternalSamples) with every
+        whole internal sample there is so far, with the wet rows cleared. Writes numSamples of the
+        result, brought back up to the host rate, into wet.
+    */
+    template <typename RunBank>
+    void process(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples, RunBank&& runBank) noexcept
+    {
+        pushInput(input, numChannels, numSamples);
+
+        if (auto numInternal = numPendingInput / factor; numInternal > 0)
+        {
+            decimate(numChannels, numInternal);
+            runBank(internalInput.getArrayOfReadPointers(), internalWet.getArrayOfWritePointers(), numInternal);
+            interpolate(numChannels, numInternal);
+        }
+
+        popWet(wet, numChannels, numSamples);
+    }
+
+    /** Delays the dry signal in place by the latency, so it stays lined up with the wet. numSamples
+        is at most the block size prepare() was given.
+    */
+    void delayDry(juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept;
+
+private:
+    class Stage;
+
+    void pushInput(const float* const* input, size_t numChannels, size_t numSamples) noexcept;
+    void decimate(size_t numChannels, size_t numInternal) noexcept;
+    void interpolate(size_t numChannels, size_t numInternal) noexcept;
+    void popWet(float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+    size_t factor = 1, maxInternalBlockSize = 0;
+    double internalRate = 0.0;
+    int latencySamples = 0;
+
+    // host rate first going down and internal rate first going up, each with its own history
+    juce::OwnedArray<Stage> downStages, upStages;
+
+    // what one stage hands the next, and where the last stage going up writes into pendingWet
+    std::array<juce::AudioBuffer<float>, 2> stageScratch;
+    std::vector<float*> pendingWetTargets;
+
+    // host-rate input that hasn't made a whole internal sample yet, and wet that has come back up
+    // but hasn't gone out yet. Between them they always hold factor - 1 samples
+    juce::AudioBuffer<float> pendingInput, pendingWet;
+    size_t numPendingInput = 0, numPendingWet = 0;
+
+    juce::AudioBuffer<float> internalInput, internalWet;
+
+    // one line per channel, long enough for the latency and a block
+    juce::HeapBlock<float> dryStorage;
+    std::vector<DelayLine> dryLines;
+
+    JUCE_DECLARE_NON_COPYABLE(BankDecimator)
+};
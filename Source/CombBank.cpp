@@ -0,0 +1,1009 @@
+/*
+  ==============================================================================
+
+    CombBank.cpp
+
+  ==============================================================================
+*/
+
+#include "CombBank.h"
+
+//==============================================================================
+CombBank::CombBank(size_t numCombs)
+{
+    setNumCombs(numCombs);
+}
+
+void CombBank::setNumCombs(size_t newNumCombs)
+{
+    jassert(newNumCombs >= 1 && newNumCombs <= maxNumCombs);
+    numCombs = newNumCombs;
+
+    //need to think about whether I need to initialize these values or pass them in
+    feedbackValues.assign(numCombs, 0.5f);
+    levelValues.assign(numCombs, 0.25f);
+    pitchValues.assign(numCombs, defaultPitchHz);
+    dampingValues.assign(numCombs, defaultDampingHz);
+    dampingCoefficients.assign(numCombs, 0.0f);
+    delayTimes.assign(numCombs, FractionalDelay::minDelay);
+    combSlots.assign(numCombs, inactive);
+    asleep.assign(numCombs, 0);
+    quietSamples.assign(numCombs, (size_t) 0);
+
+    feedbackTargets = feedbackValues;
+    levelTargets = levelValues;
+    delayTargets = delayTimes;
+    inputGainValues.assign(numCombs, 1.0f);
+    tapMixValues.assign(numCombs, 1.0f);
+    previousDelayTimes.assign(numCombs, (size_t) 1);
+    fadeLengths.assign(numCombs, (size_t) 0);
+    pendingActions.assign(numCombs, PendingAction::none);
+    rampRemaining.assign(numCombs, (size_t) 0);
+    rampingCombs.clear();
+    rampingCombs.reserve(numCombs);
+
+    delayLines.resize(numCombs * maxNumChannels);
+    allocateDelayLines();
+
+    savedDampingState.assign(numCombs * maxNumChannels, 0.0f);
+    savedTapState.assign(numCombs * maxNumChannels, 0.0f);
+
+    // everything indexed by slot is sized for the whole bank up front, so activating
+    // or deactivating a comb later only repacks and never allocates
+    constexpr auto maxCombsPerGroup = laneWidth * maxRegistersPerGroup;
+    auto maxSlots = (numCombs + maxCombsPerGroup - 1) / maxCombsPerGroup * maxCombsPerGroup;
+    auto maxRegisters = maxSlots / laneWidth;
+
+    activeCombs.clear();
+    activeCombs.reserve(numCombs);
+    slotTaps.assign(maxSlots, (size_t) 1);
+    slotPreviousDelays.assign(maxSlots, (size_t) 1);
+
+    for (auto* groups : { &groupMinDelays, &blockGroups, &lockstepGroups })
+        groups->assign(maxRegisters, 0);
+
+    rampingGroups.assign(maxRegisters, 0);
+
+    for (auto& lines : slotLines)
+        lines.assign(maxSlots, nullptr);
+
+    for (auto* lanes : { &feedback, &level, &inputGain, &damping, &tapMix, &tapDelay, &tapCoefficient,
+                         &feedbackStep, &levelStep, &inputGainStep, &tapMixStep, &tapDelayStep })
+        lanes->assign(maxRegisters, Lanes::expand(0.0f));
+
+    dampingState.assign(maxRegisters * maxNumChannels, Lanes::expand(0.0f));
+    tapState.assign(dampingState.size(), Lanes::expand(0.0f));
+
+    for (size_t comb = 0; comb < numCombs; ++comb)
+        setDampingCutoff(comb, dampingValues[comb]);
+
+    rebuildActiveList();
+}
+
+void CombBank::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    jassert(spec.numChannels <= maxNumChannels);
+    jassert(spec.sampleRate > 0.0 && spec.sampleRate <= 192e3);
+    sampleRate = spec.sampleRate;
+    numPreparedChannels = juce::jlimit((size_t) 1, maxNumChannels, (size_t) spec.numChannels);
+
+    maxBlockSize = juce::jmax((size_t) spec.maximumBlockSize, (size_t) 1);
+    numPartitions = pool != nullptr ? pool->getNumPartitions() : 1;
+
+    blockDelayed.assign(numPartitions * maxBlockSize, 0.0f);
+    blockFeedback.assign(blockDelayed.size(), 0.0f);
+    blockReads.assign(numPartitions * (maxBlockSize + FractionalDelay::maxNumReads - 1), 0.0f);
+    partialWet.assign((numPartitions - 1) * numPreparedChannels * maxBlockSize, 0.0f);
+    allocateDelayLines();
+    reset();
+}
+
+void CombBank::allocateDelayLines()
+{
+    maxDelaySamples = (size_t) std::ceil(sampleRate / minPitchHz);
+    auto lineCapacity = DelayLine::capacityFor(juce::jmax(maxDelaySamples + FractionalDelay::maxReadsPastDelay, cacheLineFloats));
+
+    // only the channels we were prepared for get memory, plus a tiny line per channel for padding lanes.
+    // Preparing again with the same layout reuses the arena as it is
+    auto numFloats = (numCombs * lineCapacity + cacheLineFloats) * numPreparedChannels;
+
+    if (numFloats != arenaSize)
+    {
+        arena.allocate(numFloats + cacheLineFloats, false);
+        arenaSize = numFloats;
+    }
+
+    auto* nextLine = getAlignedArena();
+
+    for (size_t comb = 0; comb < numCombs; ++comb)
+    {
+        for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+        {
+            getDelayLine(comb, ch).setStorage(nextLine, lineCapacity);
+            nextLine += lineCapacity;
+        }
+    }
+
+    for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+    {
+        paddingLines[ch].setStorage(nextLine, cacheLineFloats);
+        nextLine += cacheLineFloats;
+    }
+
+    // the tap positions and damping coefficients depend on the sample rate, the settings don't
+    for (size_t comb = 0; comb < numCombs; ++comb)
+    {
+        setPitch(comb, pitchValues[comb]);
+        setDampingCutoff(comb, dampingValues[comb]);
+    }
+}
+
+float* CombBank::getAlignedArena() const noexcept
+{
+    auto address = reinterpret_cast<uintptr_t>(arena.get());
+    auto alignment = (uintptr_t) (cacheLineFloats * sizeof(float));
+    return reinterpret_cast<float*>((address + alignment - 1) & ~(alignment - 1));
+}
+
+size_t CombBank::getMemoryFootprint() const noexcept
+{
+    auto bytes = sizeof(*this) + (arenaSize + cacheLineFloats) * sizeof(float);
+
+    for (auto* lanes : { &feedback, &level, &inputGain, &damping, &tapMix, &tapDelay, &tapCoefficient, &feedbackStep, &levelStep,
+                         &inputGainStep, &tapMixStep, &tapDelayStep, &dampingState, &tapState })
+        bytes += lanes->capacity() * sizeof(Lanes);
+
+    for (auto& lines : slotLines)
+        bytes += lines.capacity() * sizeof(DelayLine*);
+
+    for (auto* scratch : { &blockDelayed, &blockFeedback, &blockReads, &partialWet })
+        bytes += scratch->capacity() * sizeof(float);
+
+    for (auto* values : { &feedbackValues, &levelValues, &pitchValues, &dampingValues, &dampingCoefficients, &delayTimes,
+                          &savedDampingState, &savedTapState, &feedbackTargets, &levelTargets, &delayTargets,
+                          &inputGainValues, &tapMixValues })
+        bytes += values->capacity() * sizeof(float);
+
+    for (auto* indices : { &combSlots, &activeCombs, &slotTaps, &slotPreviousDelays,
+                           &rampRemaining, &rampingCombs, &previousDelayTimes, &fadeLengths, &quietSamples })
+        bytes += indices->capacity() * sizeof(size_t);
+
+    return bytes + delayLines.capacity() * sizeof(DelayLine) + pendingActions.capacity() * sizeof(PendingAction)
+                 + asleep.capacity();
+}
+
+void CombBank::reset() noexcept
+{
+    // everything is about to be silent, so ramps and fades can land where they were heading
+    for (auto comb : rampingCombs)
+    {
+        finishRamp(comb);
+        rampRemaining[comb] = 0;
+        inputGainValues[comb] = 1.0f;
+    }
+
+    rampingCombs.clear();
+
+    std::fill(dampingState.begin(), dampingState.end(), Lanes::expand(0.0f));
+    std::fill(savedDampingState.begin(), savedDampingState.end(), 0.0f);
+    std::fill(tapState.begin(), tapState.end(), Lanes::expand(0.0f));
+    std::fill(savedTapState.begin(), savedTapState.end(), 0.0f);
+
+    juce::FloatVectorOperations::clear(getAlignedArena(), (int) arenaSize);
+    rebuildActiveList();
+}
+
+//==============================================================================
+void CombBank::setActive(size_t comb, bool shouldBeActive, size_t fadeSamples) noexcept
+{
+    jassert(comb < numCombs);
+
+    if (fadeSamples == 0)
+    {
+        // switching at once overrides any fade-out or restart that was on its way
+        pendingActions[comb] = PendingAction::none;
+
+        if (isActive(comb) != shouldBeActive)
+        {
+            // the real slot is handed out by rebuildActiveList(), anything but inactive marks it as wanted
+            combSlots[comb] = shouldBeActive ? 0 : inactive;
+            rebuildActiveList();
+        }
+        else if (isPacked(comb))
+        {
+            updateSlot(combSlots[comb]);
+        }
+
+        return;
+    }
+
+    if (isActive(comb))
+    {
+        // switching an active comb on again only cancels a fade-out, a pending restart still happens
+        if (shouldBeActive && pendingActions[comb] != PendingAction::deactivate) return;
+        pendingActions[comb] = shouldBeActive ? PendingAction::none : PendingAction::deactivate;
+    }
+    else
+    {
+        if (! shouldBeActive) return;
+
+        // an empty line is silent, so only the input has to fade in
+        clearComb(comb);
+        inputGainValues[comb] = 0.0f;
+        combSlots[comb] = 0;
+        rebuildActiveList();
+    }
+
+    fadeLengths[comb] = fadeSamples;
+    startRamp(comb, fadeSamples);
+}
+
+void CombBank::resetComb(size_t comb, size_t fadeSamples) noexcept
+{
+    jassert(comb < numCombs);
+
+    if (fadeSamples == 0 || ! isPacked(comb))
+    {
+        clearComb(comb);
+        return;
+    }
+
+    if (pendingActions[comb] == PendingAction::none)
+        pendingActions[comb] = PendingAction::restart;
+
+    fadeLengths[comb] = fadeSamples;
+    startRamp(comb, fadeSamples);
+}
+
+void CombBank::clearComb(size_t comb) noexcept
+{
+    for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+        getDelayLine(comb, ch).clear();
+
+    for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+    {
+        savedDampingState[comb * maxNumChannels + ch] = 0.0f;
+        savedTapState[comb * maxNumChannels + ch] = 0.0f;
+
+        if (isPacked(comb))
+        {
+            auto index = (combSlots[comb] / laneWidth) * maxNumChannels + ch;
+            dampingState[index].set(combSlots[comb] % laneWidth, 0.0f);
+            tapState[index].set(combSlots[comb] % laneWidth, 0.0f);
+        }
+    }
+}
+
+void CombBank::setFeedback(size_t comb, float newValue, size_t rampSamples) noexcept
+{
+    jassert(comb < numCombs && newValue >= 0.0f && newValue <= 1.0f);
+    feedbackTargets[comb] = newValue;
+    startRamp(comb, rampSamples);
+}
+
+void CombBank::setLevel(size_t comb, float newValue, size_t rampSamples) noexcept
+{
+    jassert(comb < numCombs && newValue >= 0.0f && newValue <= 1.0f);
+    levelTargets[comb] = newValue;
+    startRamp(comb, rampSamples);
+}
+
+void CombBank::startRamp(size_t comb, size_t rampSamples) noexcept
+{
+    if (rampSamples == 0)
+    {
+        if (rampRemaining[comb] > 0)
+            rampingCombs.erase(std::find(rampingCombs.begin(), rampingCombs.end(), comb));
+
+        // a restart goes straight into its fade-in
+        finishRamp(comb);
+        if (rampRemaining[comb] > 0)
+            rampingCombs.push_back(comb);
+    }
+    else
+    {
+        if (rampRemaining[comb] == 0)
+            rampingCombs.push_back(comb);
+
+        rampRemaining[comb] = rampSamples;
+    }
+
+    if (isPacked(comb)) updateSlot(combSlots[comb]);
+}
+
+void CombBank::finishRamp(size_t comb) noexcept
+{
+    feedbackValues[comb] = feedbackTargets[comb];
+    levelValues[comb] = levelTargets[comb];
+    inputGainValues[comb] = 1.0f;
+    tapMixValues[comb] = 1.0f;
+    delayTimes[comb] = delayTargets[comb];
+    previousDelayTimes[comb] = (size_t) juce::roundToInt(delayTimes[comb]);
+    rampRemaining[comb] = 0;
+
+    auto action = pendingActions[comb];
+    pendingActions[comb] = PendingAction::none;
+
+    if (action == PendingAction::deactivate)
+    {
+        combSlots[comb] = inactive;
+        rebuildActiveList();
+    }
+    else if (action == PendingAction::restart)
+    {
+        // the output is silent by now, so the line can be emptied and the input faded back in
+        clearComb(comb);
+        inputGainValues[comb] = 0.0f;
+        rampRemaining[comb] = fadeLengths[comb];
+    }
+}
+
+void CombBank::advanceRamps(size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < rampingCombs.size();)
+    {
+        auto comb = rampingCombs[i];
+        auto& remaining = rampRemaining[comb];
+
+        if (numSamples >= remaining)
+        {
+            finishRamp(comb);
+
+            if (remaining > 0)
+            {
+                ++i;
+            }
+            else
+            {
+                // order doesn't matter, so swap the last one in rather than shifting
+                rampingCombs[i] = rampingCombs.back();
+                rampingCombs.pop_back();
+            }
+        }
+        else
+        {
+            // the same distance the kernel covered with its per-sample steps
+            auto fraction = (float) numSamples / (float) remaining;
+            feedbackValues[comb] += (feedbackTargets[comb] - feedbackValues[comb]) * fraction;
+            levelValues[comb] += (getLevelTarget(comb) - levelValues[comb]) * fraction;
+            inputGainValues[comb] += (1.0f - inputGainValues[comb]) * fraction;
+            tapMixValues[comb] += (1.0f - tapMixValues[comb]) * fraction;
+            delayTimes[comb] += (delayTargets[comb] - delayTimes[comb]) * fraction;
+            remaining -= numSamples;
+            ++i;
+        }
+
+        if (isPacked(comb)) updateSlot(combSlots[comb]);
+    }
+}
+
+void CombBank::setPitch(size_t comb, float frequencyHz, size_t fadeSamples) noexcept
+{
+    jassert(comb < numCombs && frequencyHz >= minPitchHz);
+    pitchValues[comb] = frequencyHz;
+    auto newDelay = pitchToDelay(frequencyHz);
+
+    // the same delay again leaves any crossfade or glide that is still running alone
+    if (newDelay == delayTargets[comb]) return;
+
+    setDelay(comb, newDelay, fadeSamples);
+    pitchValues[comb] = frequencyHz;
+}
+
+void CombBank::glidePitch(size_t comb, float frequencyHz, size_t glideSamples) noexcept
+{
+    jassert(comb < numCombs && frequencyHz >= minPitchHz);
+    glideDelay(comb, pitchToDelay(frequencyHz), glideSamples);
+    pitchValues[comb] = frequencyHz;
+}
+
+void CombBank::glideDelay(size_t comb, float delayInSamples, size_t glideSamples) noexcept
+{
+    jassert(comb < numCombs);
+    auto delay = juce::jlimit(FractionalDelay::minDelay, (float) maxDelaySamples, delayInSamples);
+
+    // the same delay again leaves any crossfade or glide that is still running alone
+    if (delay == delayTargets[comb]) return;
+
+    if (glideSamples == 0 || ! isPacked(comb))
+    {
+        setDelay(comb, delay);
+        return;
+    }
+
+    // a new target mid-glide bends off from wherever the delay has got to
+    pitchValues[comb] = (float) (sampleRate / (double) delay);
+    delayTargets[comb] = delay;
+    startRamp(comb, glideSamples);
+}
+
+void CombBank::setDelay(size_t comb, float delayInSamples, size_t fadeSamples) noexcept
+{
+    jassert(comb < numCombs && delayInSamples >= FractionalDelay::minDelay && delayInSamples <= (float) maxDelaySamples);
+    auto delay = juce::jlimit(FractionalDelay::minDelay, (float) maxDelaySamples, delayInSamples);
+
+    if (fadeSamples > 0 && isPacked(comb))
+    {
+        // the same delay again leaves any crossfade or glide that is still running alone
+        if (delay == delayTargets[comb]) return;
+
+        // a crossfade only has room for two taps, so one that is cut short keeps whichever is louder
+        if (tapMixValues[comb] >= 0.5f)
+            previousDelayTimes[comb] = (size_t) juce::roundToInt(delayTimes[comb]);
+
+        delayTimes[comb] = delayTargets[comb] = delay;
+        pitchValues[comb] = (float) (sampleRate / (double) delay);
+        tapMixValues[comb] = 0.0f;
+        fadeLengths[comb] = fadeSamples;
+        startRamp(comb, fadeSamples);
+        return;
+    }
+
+    delayTimes[comb] = delayTargets[comb] = delay;
+    previousDelayTimes[comb] = (size_t) juce::roundToInt(delay);
+    pitchValues[comb] = (float) (sampleRate / (double) delay);
+    tapMixValues[comb] = 1.0f;
+    if (isPacked(comb)) updateSlot(combSlots[comb]);
+}
+
+size_t CombBank::getMaxDelay(size_t comb) const noexcept
+{
+    // the furthest sample the interpolation reads, which a glide may still be heading towards
+    auto delay = juce::jmax(delayTimes[comb], delayTargets[comb]);
+    return juce::jmax((size_t) std::ceil(delay) + FractionalDelay::maxReadsPastDelay, previousDelayTimes[comb]);
+}
+
+float CombBank::getStatePeak(const std::vector<Lanes>& packed, const std::vector<float>& saved, size_t comb) const noexcept
+{
+    auto peak = 0.0f;
+
+    for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+    {
+        auto value = isPacked(comb) ? packed[(combSlots[comb] / laneWidth) * maxNumChannels + ch].get(combSlots[comb] % laneWidth)
+                                    : saved[comb * maxNumChannels + ch];
+        peak = juce::jmax(peak, std::abs(value));
+    }
+
+    return peak;
+}
+
+void CombBank::setInterpolation(FractionalDelay::Type newType) noexcept
+{
+    if (newType == interpolationType) return;
+    interpolationType = newType;
+
+    // every tap moves, and the allpass starts again from silence
+    std::fill(tapState.begin(), tapState.end(), Lanes::expand(0.0f));
+    std::fill(savedTapState.begin(), savedTapState.end(), 0.0f);
+
+    for (size_t slot = 0; slot < numActiveRegisters * laneWidth; ++slot)
+        updateSlot(slot);
+}
+
+void CombBank::setDampingCutoff(size_t comb, float cutoffHz) noexcept
+{
+    jassert(comb < numCombs && cutoffHz > 0.0f);
+    dampingValues[comb] = cutoffHz;
+    dampingCoefficients[comb] = DampingFilter::coefficientFor(juce::jmin((double) cutoffHz, sampleRate * 0.5), sampleRate);
+    if (isPacked(comb)) updateSlot(combSlots[comb]);
+}
+
+float CombBank::pitchToDelay(float frequencyHz) const noexcept
+{
+    auto delay = (float) (sampleRate / (double) juce::jmax(frequencyHz, minPitchHz));
+    return juce::jlimit(FractionalDelay::minDelay, (float) maxDelaySamples, delay);
+}
+
+//==============================================================================
+void CombBank::rebuildActiveList() noexcept
+{
+    // filter state lives in the lanes while a comb is packed, so park it before the lanes move
+    for (size_t slot = 0; slot < activeCombs.size(); ++slot)
+    {
+        for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+        {
+            auto index = (slot / laneWidth) * maxNumChannels + ch;
+            savedDampingState[activeCombs[slot] * maxNumChannels + ch] = dampingState[index].get(slot % laneWidth);
+            savedTapState[activeCombs[slot] * maxNumChannels + ch] = tapState[index].get(slot % laneWidth);
+        }
+    }
+
+    // a comb switched off while asleep wakes up inactive, and one switched off while awake
+    // starts counting quiet samples again when it comes back
+    activeCombs.clear();
+    numAsleep = 0;
+
+    for (size_t comb = 0; comb < numCombs; ++comb)
+    {
+        if (! isActive(comb))
+        {
+            asleep[comb] = 0;
+            quietSamples[comb] = 0;
+        }
+
+        if (asleep[comb])        ++numAsleep;
+        else if (isActive(comb)) activeCombs.push_back(comb);
+    }
+
+    // longest delays first, so combs that can take the block path tend to share groups
+    std::sort(activeCombs.begin(), activeCombs.end(), [this](size_t a, size_t b)
+    {
+        return delayTimes[a] != delayTimes[b] ? delayTimes[a] > delayTimes[b] : a < b;
+    });
+
+    // wider groups give the CPU more independent registers to work on at once, as long as
+    // there are still enough groups to go round every partition
+    auto numActive = activeCombs.size();
+    registersPerGroup = numActive >= 4 * laneWidth * numPartitions ? 4
+                      : numActive >= 2 * laneWidth * numPartitions ? 2 : 1;
+
+    auto combsPerGroup = laneWidth * registersPerGroup;
+    auto numSlots = (numActive + combsPerGroup - 1) / combsPerGroup * combsPerGroup;
+    numActiveRegisters = numSlots / laneWidth;
+
+    for (size_t slot = 0; slot < numSlots; ++slot)
+    {
+        if (slot < numActive) combSlots[activeCombs[slot]] = slot;
+
+        for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+        {
+            auto index = (slot / laneWidth) * maxNumChannels + ch;
+            auto saved = slot < numActive ? activeCombs[slot] * maxNumChannels + ch : inactive;
+            dampingState[index].set(slot % laneWidth, saved != inactive ? savedDampingState[saved] : 0.0f);
+            tapState[index].set(slot % laneWidth, saved != inactive ? savedTapState[saved] : 0.0f);
+        }
+
+        updateSlot(slot);
+    }
+}
+
+void CombBank::updateSlot(size_t slot) noexcept
+{
+    auto reg = slot / laneWidth, lane = slot % laneWidth;
+    auto isPadding = slot >= activeCombs.size();
+    auto comb = isPadding ? inactive : activeCombs[slot];
+
+    feedback[reg].set(lane, isPadding ? 0.0f : feedbackValues[comb]);
+    level[reg].set(lane, isPadding ? 0.0f : levelValues[comb]);
+    inputGain[reg].set(lane, isPadding ? 0.0f : inputGainValues[comb]);
+    tapMix[reg].set(lane, isPadding ? 1.0f : tapMixValues[comb]);
+    damping[reg].set(lane, isPadding ? 0.0f : dampingCoefficients[comb]);
+    slotPreviousDelays[slot] = isPadding ? 1 : previousDelayTimes[comb];
+
+    // padding reads its silent line as close as any type can
+    auto delay = isPadding ? FractionalDelay::minDelay : delayTimes[comb];
+    auto split = FractionalDelay::split(interpolationType, delay);
+    slotTaps[slot] = split.tap;
+    tapDelay[reg].set(lane, delay);
+    tapCoefficient[reg].set(lane, FractionalDelay::coefficientFor(interpolationType, split.fraction));
+
+    auto remaining = isPadding ? 0 : rampRemaining[comb];
+    auto stepTowards = [remaining](float target, float value) { return remaining > 0 ? (target - value) / (float) remaining : 0.0f; };
+
+    feedbackStep[reg].set(lane, isPadding ? 0.0f : stepTowards(feedbackTargets[comb], feedbackValues[comb]));
+    levelStep[reg].set(lane, isPadding ? 0.0f : stepTowards(getLevelTarget(comb), levelValues[comb]));
+    inputGainStep[reg].set(lane, isPadding ? 0.0f : stepTowards(1.0f, inputGainValues[comb]));
+    tapMixStep[reg].set(lane, isPadding ? 0.0f : stepTowards(1.0f, tapMixValues[comb]));
+    tapDelayStep[reg].set(lane, isPadding ? 0.0f : stepTowards(delayTargets[comb], delayTimes[comb]));
+
+    for (size_t ch = 0; ch < numPreparedChannels; ++ch)
+        slotLines[ch][slot] = isPadding ? &paddingLines[ch] : &getDelayLine(comb, ch);
+
+    updateGroupMinDelay(slot / (laneWidth * registersPerGroup));
+}
+
+void CombBank::updateGroupMinDelay(size_t group) noexcept
+{
+    auto combsPerGroup = laneWidth * registersPerGroup;
+    auto firstSlot = group * combsPerGroup;
+    auto endSlot = juce::jmin(firstSlot + combsPerGroup, activeCombs.size());
+
+    // the interpolation may read a sample nearer than the tap itself
+    auto readsBeforeTap = FractionalDelay::getReadsBeforeTap(interpolationType);
+    auto minDelay = std::numeric_limits<size_t>::max();
+
+    for (auto slot = firstSlot; slot < endSlot; ++slot)
+        minDelay = juce::jmin(minDelay, slotTaps[slot] - readsBeforeTap);
+
+    groupMinDelays[group] = minDelay;
+}
+
+//==============================================================================
+void CombBank::process(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    jassert(numChannels <= numPreparedChannels);
+    jassert(! blockDelayed.empty()); // prepare() hasn't been called
+
+    auto inputPeak = 0.0f;
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        auto range = juce::FloatVectorOperations::findMinAndMax(input[ch], (int) numSamples);
+        inputPeak = juce::jmax(inputPeak, -range.getStart(), range.getEnd());
+    }
+
+    // whatever gets in comes out of every comb at some level, whatever it is tuned to, so input
+    // above the threshold would be heard through every sleeper
+    auto inputIsSilent = inputPeak <= sleepThreshold;
+    if (! inputIsSilent)
+        wakeAll();
+
+    if (activeCombs.empty())
+    {
+        // ramps keep time even when nothing is listening
+        advanceRamps(numSamples);
+        return;
+    }
+
+    // the block path needs scratch for a whole block, so anything longer goes in pieces, and each
+    // piece is split again wherever a ramp ends so the steps never overshoot their targets
+    for (size_t start = 0; start < numSamples;)
+    {
+        auto segment = juce::jmin(maxBlockSize, numSamples - start);
+        for (auto comb : rampingCombs)
+            segment = juce::jmin(segment, rampRemaining[comb]);
+
+        std::array<const float*, maxNumChannels> in {};
+        std::array<float*, maxNumChannels> out {};
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            in[ch] = input[ch] + start;
+            out[ch] = wet[ch] + start;
+        }
+
+        processSegment(in.data(), out.data(), numChannels, segment);
+
+        if (! rampingCombs.empty())
+            advanceRamps(segment);
+
+        start += segment;
+    }
+
+    if (inputIsSilent)
+        updateSleep(numChannels, numSamples);
+}
+
+void CombBank::wakeAll() noexcept
+{
+    // the counts only mean anything through an unbroken run of silent input
+    std::fill(quietSamples.begin(), quietSamples.end(), (size_t) 0);
+
+    if (numAsleep == 0) return;
+
+    std::fill(asleep.begin(), asleep.end(), (char) 0);
+    rebuildActiveList();
+}
+
+void CombBank::updateSleep(size_t numChannels, size_t numSamples) noexcept
+{
+    auto anyFellAsleep = false;
+
+    for (auto comb : activeCombs)
+    {
+        auto peak = 0.0f;
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto& line = getDelayLine(comb, ch);
+            peak = juce::jmax(peak, line.getRecentPeak(juce::jmin(numSamples, line.size())));
+        }
+
+        if (peak > sleepThreshold)
+        {
+            quietSamples[comb] = 0;
+            continue;
+        }
+
+        // everything the taps can reach was written within the longest delay, so once that long has been
+        // quiet the whole line is. A comb in the middle of a ramp or fade finishes it first
+        quietSamples[comb] += numSamples;
+
+        if (quietSamples[comb] < getMaxDelay(comb) || rampRemaining[comb] != 0 || pendingActions[comb] != PendingAction::none)
+            continue;
+
+        // the filter state decays on its own from the last loud reads, and clearing it while it can
+        // still be heard would click. No ramp is running, so the level is where it will stay
+        auto heldState = juce::jmax(getDampingStatePeak(comb), getTapStatePeak(comb));
+
+        if (heldState * levelValues[comb] <= sleepThreshold)
+        {
+            clearComb(comb);
+            asleep[comb] = 1;
+            anyFellAsleep = true;
+        }
+    }
+
+    if (anyFellAsleep)
+        rebuildActiveList();
+}
+
+void CombBank::processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    switch (registersPerGroup)
+    {
+        case 4:  processSegment<4>(input, wet, numChannels, numSamples); break;
+        case 2:  processSegment<2>(input, wet, numChannels, numSamples); break;
+        default: processSegment<1>(input, wet, numChannels, numSamples); break;
+    }
+}
+
+template <size_t RegistersPerGroup>
+void CombBank::processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    switch (saturatorType)
+    {
+        case Saturator::Type::exact:    processSegment<RegistersPerGroup, Saturator::Type::exact>(input, wet, numChannels, numSamples); break;
+        case Saturator::Type::rational: processSegment<RegistersPerGroup, Saturator::Type::rational>(input, wet, numChannels, numSamples); break;
+        case Saturator::Type::table:    processSegment<RegistersPerGroup, Saturator::Type::table>(input, wet, numChannels, numSamples); break;
+    }
+}
+
+template <size_t RegistersPerGroup, Saturator::Type SaturatorType>
+void CombBank::processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    using Type = FractionalDelay::Type;
+
+    switch (interpolationType)
+    {
+        case Type::linear:    processChannels<RegistersPerGroup, SaturatorType, Type::linear>(input, wet, numChannels, numSamples); break;
+        case Type::lagrange3: processChannels<RegistersPerGroup, SaturatorType, Type::lagrange3>(input, wet, numChannels, numSamples); break;
+        case Type::thiran:    processChannels<RegistersPerGroup, SaturatorType, Type::thiran>(input, wet, numChannels, numSamples); break;
+    }
+}
+
+template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+void CombBank::processChannels(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept
+{
+    constexpr auto combsPerGroup = laneWidth * RegistersPerGroup;
+    auto numGroups = numActiveRegisters / RegistersPerGroup;
+    auto ramping = ! rampingCombs.empty();
+
+    if (ramping)
+    {
+        std::fill(rampingGroups.begin(), rampingGroups.begin() + (std::ptrdiff_t) numGroups, (char) 0);
+
+        for (auto comb : rampingCombs)
+            if (isPacked(comb))
+                rampingGroups[combSlots[comb] / combsPerGroup] = 1;
+    }
+
+    numBlockGroups = numLockstepGroups = 0;
+
+    for (size_t group = 0; group < numGroups; ++group)
+    {
+        if (groupMinDelays[group] >= numSamples && ! (ramping && rampingGroups[group]))
+            blockGroups[numBlockGroups++] = group;
+        else
+            lockstepGroups[numLockstepGroups++] = group;
+    }
+
+    // a partition needs at least one group of either kind to be worth waking a thread for
+    auto usefulPartitions = juce::jmin(numPartitions, juce::jmax(numLockstepGroups, numBlockGroups));
+
+    if (pool == nullptr || usefulPartitions <= 1)
+    {
+        processPartition<RegistersPerGroup, SaturatorType, InterpolationType>(0, 1, input, wet, numChannels, numSamples);
+        return;
+    }
+
+    auto job = [&](size_t partition)
+    {
+        if (partition < usefulPartitions)
+            processPartition<RegistersPerGroup, SaturatorType, InterpolationType>(partition, usefulPartitions, input, wet, numChannels, numSamples);
+    };
+
+    pool->run(job);
+
+    for (size_t partition = 1; partition < usefulPartitions; ++partition)
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            juce::FloatVectorOperations::add(wet[ch], partialWet.data() + ((partition - 1) * numPreparedChannels + ch) * maxBlockSize, (int) numSamples);
+}
+
+template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+void CombBank::processPartition(size_t partition, size_t numParts, const float* const* input, float* const* wet,
+                                size_t numChannels, size_t numSamples) noexcept
+{
+    constexpr auto combsPerGroup = laneWidth * RegistersPerGroup;
+
+    // each partition takes an even, contiguous share of both lists, so no two touch the same comb
+    auto firstLockstep = numLockstepGroups * partition / numParts;
+    auto endLockstep = numLockstepGroups * (partition + 1) / numParts;
+    auto firstBlock = numBlockGroups * partition / numParts;
+    auto endBlock = numBlockGroups * (partition + 1) / numParts;
+
+    // the first partition adds straight into wet, the rest into partial sums that are added afterwards
+    std::array<float*, maxNumChannels> out {};
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        if (partition == 0)
+        {
+            out[ch] = wet[ch];
+        }
+        else
+        {
+            out[ch] = partialWet.data() + ((partition - 1) * numPreparedChannels + ch) * maxBlockSize;
+            juce::FloatVectorOperations::clear(out[ch], (int) numSamples);
+        }
+    }
+
+    // steady values skip the per-sample step arithmetic altogether
+    if (! rampingCombs.empty())
+        processLockstep<RegistersPerGroup, SaturatorType, InterpolationType, true>(lockstepGroups.data() + firstLockstep, endLockstep - firstLockstep,
+                                                                                   input, out.data(), numChannels, numSamples);
+    else
+        processLockstep<RegistersPerGroup, SaturatorType, InterpolationType, false>(lockstepGroups.data() + firstLockstep, endLockstep - firstLockstep,
+                                                                                    input, out.data(), numChannels, numSamples);
+
+    auto* delayed = blockDelayed.data() + partition * maxBlockSize;
+    auto* dlineInput = blockFeedback.data() + partition * maxBlockSize;
+    auto* reads = blockReads.data() + partition * (maxBlockSize + FractionalDelay::maxNumReads - 1);
+
+    for (auto i = firstBlock; i < endBlock; ++i)
+    {
+        auto firstSlot = blockGroups[i] * combsPerGroup;
+        auto endSlot = juce::jmin(firstSlot + combsPerGroup, activeCombs.size());
+
+        for (auto slot = firstSlot; slot < endSlot; ++slot)
+            processSlotBlock<SaturatorType, InterpolationType>(slot, input, out.data(), numChannels, numSamples, delayed, dlineInput, reads);
+    }
+}
+
+template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType, bool Ramping>
+void CombBank::processLockstep(const size_t* groups, size_t numGroups, const float* const* input, float* const* wet,
+                               size_t numChannels, size_t numSamples) noexcept
+{
+    if (numGroups == 0) return;
+
+    constexpr auto combsPerGroup = laneWidth * RegistersPerGroup;
+    constexpr auto numReads = FractionalDelay::numReads<InterpolationType>;
+    constexpr auto readsBeforeTap = FractionalDelay::readsBeforeTap<InterpolationType>;
+
+    alignas(Lanes) float gathered[numReads][combsPerGroup];
+    alignas(Lanes) float written[combsPerGroup];
+    alignas(Lanes) float previous[combsPerGroup];
+    [[maybe_unused]] alignas(Lanes) float blends[combsPerGroup];
+    [[maybe_unused]] size_t glidingTaps[combsPerGroup];
+    std::array<Lanes, maxNumChannels> wetSums;
+
+    // frame by frame, so each group's values are loaded once and shared by every channel
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        std::fill(wetSums.begin(), wetSums.begin() + (std::ptrdiff_t) numChannels, Lanes::expand(0.0f));
+
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            auto group = groups[g];
+            auto firstSlot = group * combsPerGroup;
+            auto firstReg = group * RegistersPerGroup;
+
+            Lanes fb[RegistersPerGroup], lv[RegistersPerGroup], gain[RegistersPerGroup], coefficient[RegistersPerGroup];
+            Lanes blend[RegistersPerGroup];
+            [[maybe_unused]] Lanes mix[RegistersPerGroup];
+            auto* taps = slotTaps.data() + firstSlot;
+
+            for (size_t r = 0; r < RegistersPerGroup; ++r)
+            {
+                auto reg = firstReg + r;
+                coefficient[r] = damping[reg];
+
+                if constexpr (Ramping)
+                {
+                    // every ramp is a straight line from the value at the start of the segment
+                    auto position = Lanes::expand((float) i);
+                    fb[r] = feedback[reg] + feedbackStep[reg] * position;
+                    lv[r] = level[reg] + levelStep[reg] * position;
+                    gain[r] = inputGain[reg] + inputGainStep[reg] * position;
+                    mix[r] = tapMix[reg] + tapMixStep[reg] * position;
+                    (tapDelay[reg] + tapDelayStep[reg] * position).copyToRawArray(blends + r * laneWidth);
+                }
+                else
+                {
+                    fb[r] = feedback[reg];
+                    lv[r] = level[reg];
+                    gain[r] = inputGain[reg];
+                    blend[r] = tapCoefficient[reg];
+                }
+            }
+
+            if constexpr (Ramping)
+            {
+                // a gliding delay crosses whole samples as it goes, so it is split again every sample
+                for (size_t lane = 0; lane < combsPerGroup; ++lane)
+                {
+                    auto split = FractionalDelay::split<InterpolationType>(blends[lane]);
+                    glidingTaps[lane] = split.tap;
+                    blends[lane] = FractionalDelay::coefficientFor<InterpolationType>(split.fraction);
+                }
+
+                for (size_t r = 0; r < RegistersPerGroup; ++r)
+                    blend[r] = Lanes::fromRawArray(blends + r * laneWidth);
+
+                taps = glidingTaps;
+            }
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                auto* lines = slotLines[ch].data() + firstSlot;
+                auto* state = dampingState.data() + firstReg * maxNumChannels + ch;
+                auto* interpolatorState = tapState.data() + firstReg * maxNumChannels + ch;
+                auto in = Lanes::expand(input[ch][i]);
+
+                for (size_t lane = 0; lane < combsPerGroup; ++lane)
+                {
+                    auto nearest = taps[lane] - readsBeforeTap;
+
+                    for (size_t k = 0; k < numReads; ++k)
+                        gathered[k][lane] = lines[lane]->get(nearest + k);
+                }
+
+                if constexpr (Ramping)
+                    for (size_t lane = 0; lane < combsPerGroup; ++lane)
+                        previous[lane] = lines[lane]->get(slotPreviousDelays[firstSlot + lane]);
+
+                for (size_t r = 0; r < RegistersPerGroup; ++r)
+                {
+                    Lanes reads[numReads];
+                    for (size_t k = 0; k < numReads; ++k)
+                        reads[k] = Lanes::fromRawArray(gathered[k] + r * laneWidth);
+
+                    auto delayed = FractionalDelay::interpolate<InterpolationType>(reads, blend[r], interpolatorState[r * maxNumChannels]);
+
+                    if constexpr (Ramping)
+                    {
+                        auto oldTap = Lanes::fromRawArray(previous + r * laneWidth);
+                        delayed = oldTap + (delayed - oldTap) * mix[r];
+                    }
+
+                    auto filtered = DampingFilter::processSample(delayed, state[r * maxNumChannels], coefficient[r]);
+
+                    wetSums[ch] += lv[r] * filtered;
+                    (gain[r] * in + fb[r] * filtered).copyToRawArray(written + r * laneWidth);
+                }
+
+                // saturating keeps the feedback sum from running away
+                Saturator::process<SaturatorType>(written, combsPerGroup);
+
+                for (size_t lane = 0; lane < combsPerGroup; ++lane)
+                    lines[lane]->push(written[lane]);
+            }
+        }
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+            wet[ch][i] += wetSums[ch].sum();
+    }
+}
+
+template <Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+void CombBank::processSlotBlock(size_t slot, const float* const* input, float* const* wet, size_t numChannels, size_t numSamples,
+                                float* delayed, float* dlineInput, float* reads) noexcept
+{
+    constexpr auto numReads = FractionalDelay::numReads<InterpolationType>;
+    constexpr auto readsBeforeTap = FractionalDelay::readsBeforeTap<InterpolationType>;
+
+    auto reg = slot / laneWidth, lane = slot % laneWidth;
+    auto fb = feedback[reg].get(lane), lv = level[reg].get(lane), coefficient = damping[reg].get(lane);
+    auto blend = tapCoefficient[reg].get(lane);
+    auto furthest = slotTaps[slot] - readsBeforeTap + numReads - 1;
+
+    for (size_t ch = 0; ch < numChannels; ++ch)
+    {
+        auto& dline = *slotLines[ch][slot];
+
+        // the whole block was written before it started, so every sample it blends comes out of the
+        // line in one read
+        dline.read(furthest, reads, numSamples + numReads - 1);
+
+        auto& interpolatorState = tapState[reg * maxNumChannels + ch];
+        interpolatorState.set(lane, FractionalDelay::processBlock<InterpolationType>(reads, delayed, numSamples, blend,
+                                                                                    interpolatorState.get(lane)));
+
+        // the filter is a recurrence, so it is the one part that stays sample by sample
+        auto& state = dampingState[reg * maxNumChannels + ch];
+        state.set(lane, DampingFilter::processBlock(delayed, numSamples, state.get(lane), coefficient));
+
+        juce::FloatVectorOperations::copy(dlineInput, input[ch], (int) numSamples);
+        juce::FloatVectorOperations::addWithMultiply(dlineInput, delayed, fb, (int) numSamples);
+        Saturator::process<SaturatorType>(dlineInput, numSamples);
+        dline.write(dlineInput, numSamples);
+
+        juce::FloatVectorOperations::addWithMultiply(wet[ch], delayed, lv, (int) numSamples);
+    }
+}
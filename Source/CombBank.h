@@ -0,0 +1,331 @@
+/*
+  ==============================================================================
+
+    CombBank.h
+    Structure-of-arrays engine that runs the whole comb bank in SIMD lockstep.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DampingFilter.h"
+#include "DelayLine.h"
+#include "FractionalDelay.h"
+#include "Saturator.h"
+#include "WorkerPool.h"
+
+//==============================================================================
+/**
+    Each field of comb state (feedback, level, damping coefficient and damping state) is stored
+    as an array of SIMD registers, one lane per comb, so neighbouring combs are filtered, fed back
+    and mixed together. Only the delay line reads and writes are done lane by lane.
+
+    When every comb in a group has a delay at least as long as the block, nothing the block
+    reads from the delay lines is written during it, so those combs skip the per-sample lockstep
+    and run the whole block at once with FloatVectorOperations instead.
+
+    Only active combs are packed into lanes. Activating or deactivating a comb rebuilds the packing,
+    so an inactive comb costs nothing while the bank is running.
+
+    An active comb also drops out of the packing while it is asleep. After a block of silent input,
+    each awake comb checks what it wrote to its lines. Once a whole delay's worth of writes has stayed
+    under sleepThreshold, the line holds nothing louder. The damping filter and the interpolator
+    can still be carrying the last loud reads, so the comb also waits for their state, scaled by its
+    level, to fall under sleepThreshold. Then it is cleared and unpacked.
+    Any input above the threshold wakes every sleeping comb before that block is processed.
+    A comb always wakes with empty lines, and its output builds up from zero, so no fade is needed.
+
+    Sleep only starts once the input has gone quiet, never while it is playing, however far a comb is
+    tuned from the material. Every comb writes the input into its own line, and the input's first pass
+    out of the line is only shaped by the one-pole damping, so it reaches the output at every pitch.
+    Feedback then colours everything that gets in, rather than ringing on its own and dying away. A
+    comb fed anything above the threshold is therefore above it too, and putting it to sleep would take
+    an audible part of the output away. That is also why waking goes on the input level rather than on
+    energy near each comb's pitch. What sleep does save is the ring-out: each comb drops out as soon as
+    its own feedback has let it decay, instead of the whole bank running until the slowest comb has,
+    and the processor's silence skip takes over once they all have.
+
+    Delays are fractional. Each comb reads its line at a whole-sample tap and blends the samples
+    around it with FractionalDelay, lane by lane like everything else, so every pitch is in tune.
+    Gliding to a new pitch slides the delay along the comb's ramp, one step per sample. The lines
+    were sized for the lowest pitch up front, so a glide never allocates and costs the same wherever
+    it goes.
+*/
+class CombBank
+{
+public:
+   #if JUCE_USE_SIMD
+    using Lanes = juce::dsp::SIMDRegister<float>;
+   #else
+    // scalar fallback with the subset of the SIMDRegister interface the kernel uses
+    struct Lanes
+    {
+        static constexpr size_t SIMDNumElements = 1;
+
+        static Lanes expand(float s) noexcept                      { return { s }; }
+        static Lanes fromRawArray(const float* a) noexcept         { return { *a }; }
+        void copyToRawArray(float* a) const noexcept               { *a = value; }
+        float get(size_t) const noexcept                           { return value; }
+        void set(size_t, float s) noexcept                         { value = s; }
+        float sum() const noexcept                                 { return value; }
+
+        Lanes operator+ (Lanes o) const noexcept                   { return { value + o.value }; }
+        Lanes operator- (Lanes o) const noexcept                   { return { value - o.value }; }
+        Lanes operator* (Lanes o) const noexcept                   { return { value * o.value }; }
+        Lanes operator+ (float s) const noexcept                   { return { value + s }; }
+        Lanes operator- (float s) const noexcept                   { return { value - s }; }
+        Lanes operator* (float s) const noexcept                   { return { value * s }; }
+        Lanes& operator+= (Lanes o) noexcept                       { value += o.value; return *this; }
+
+        float value;
+    };
+   #endif
+
+    static constexpr size_t laneWidth = Lanes::SIMDNumElements;
+    static constexpr size_t maxRegistersPerGroup = 4;
+    static constexpr size_t maxNumChannels = 16; // third-order ambisonics
+    static constexpr size_t defaultNumCombs = 4;
+    static constexpr size_t maxNumCombs = 256;
+
+    // every delay line is sized in prepare() to hold this pitch at the host sample rate,
+    // so retuning afterwards only moves the read tap
+    static constexpr float minPitchHz = 16.35f; // C0
+    static constexpr float defaultPitchHz = 110.0f;
+    static constexpr float defaultDampingHz = 1000.0f;
+
+    static constexpr float sleepThreshold = 1.0e-6f; // -120 dBFS
+
+    //==============================================================================
+    explicit CombBank(size_t numCombs = defaultNumCombs);
+
+    /** Splits each block's groups between the calling thread and the pool's workers, each writing
+        its own partial wet sum. The scratch for that is sized in prepare(), so call it before, and
+        prepare again if the pool is resized. nullptr keeps everything on the calling thread.
+    */
+    void setWorkerPool(WorkerPool* newPool) noexcept { pool = newPool; }
+
+    /** Reallocates the bank, so call this before prepare() rather than while processing. */
+    void setNumCombs(size_t newNumCombs);
+    size_t getNumCombs() const noexcept { return numCombs; }
+
+    /** Allocates every delay line for minPitchHz at the new sample rate and channel count.
+        Nothing allocates after this.
+    */
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    void reset() noexcept;
+
+    size_t getMaxDelaySamples() const noexcept { return maxDelaySamples; }
+
+    /** Bytes held by the bank: the delay line arena plus the per-comb and per-lane state. */
+    size_t getMemoryFootprint() const noexcept;
+
+    //==============================================================================
+    /** With fadeSamples above zero a comb starts from silence and fades its input in, and stops by
+        fading its output out before it is unpacked. Without a fade it switches at once and picks up
+        where it left off. A comb that is fading out still counts as active.
+    */
+    bool isActive(size_t comb) const noexcept { return combSlots[comb] != inactive; }
+    void setActive(size_t comb, bool shouldBeActive, size_t fadeSamples = 0) noexcept;
+    void toggleActive(size_t comb, size_t fadeSamples = 0) noexcept { setActive(comb, ! isActive(comb) || isFadingOut(comb), fadeSamples); }
+    bool isFadingOut(size_t comb) const noexcept { return pendingActions[comb] == PendingAction::deactivate; }
+    size_t getNumActiveCombs() const noexcept { return activeCombs.size() + numAsleep; }
+
+    /** A sleeping comb is still active, it just isn't processed until the input comes back. */
+    bool isAsleep(size_t comb) const noexcept { return asleep[comb] != 0; }
+    size_t getNumAwakeCombs() const noexcept { return activeCombs.size(); }
+
+    /** Clears the comb's delay lines and damping state, fading the output out first if asked to. */
+    void resetComb(size_t comb, size_t fadeSamples = 0) noexcept;
+
+    /** With rampSamples above zero the value moves there in a straight line over that many samples
+        instead of jumping. Feedback, level and a pitch glide share one ramp per comb, so starting any
+        of them restarts all three, and a jump finishes whatever ramp the comb was in.
+    */
+    void setFeedback(size_t comb, float newValue, size_t rampSamples = 0) noexcept;
+    void setLevel(size_t comb, float newValue, size_t rampSamples = 0) noexcept;
+    bool isRamping() const noexcept { return ! rampingCombs.empty(); }
+
+    /** Where each value is heading, which is where it stays once any ramp has finished. */
+    float getFeedback(size_t comb) const noexcept { return feedbackTargets[comb]; }
+    float getLevel(size_t comb) const noexcept { return levelTargets[comb]; }
+
+    /** The most feedback the comb runs with until its ramp ends and the longest tap it reads until its
+        crossfade ends, so a decay worked out from them never runs ahead of the audio.
+    */
+    float getMaxFeedback(size_t comb) const noexcept { return juce::jmax(feedbackValues[comb], feedbackTargets[comb]); }
+    size_t getMaxDelay(size_t comb) const noexcept;
+
+    /** The largest damping and interpolator state the comb holds on any channel. Both come from
+        reads taken earlier, so they can stay above everything in the line after it has died down.
+    */
+    float getDampingStatePeak(size_t comb) const noexcept { return getStatePeak(dampingState, savedDampingState, comb); }
+    float getTapStatePeak(size_t comb) const noexcept { return getStatePeak(tapState, savedTapState, comb); }
+
+    /** With fadeSamples above zero the output crossfades from the old tap to the new one. */
+    void setPitch(size_t comb, float frequencyHz, size_t fadeSamples = 0) noexcept;
+
+    /** Slides the delay to the new pitch over glideSamples on the comb's ramp, so the comb bends
+        there rather than fading between two taps. A comb that isn't packed just jumps.
+    */
+    void glidePitch(size_t comb, float frequencyHz, size_t glideSamples) noexcept;
+
+    /** glidePitch() for a delay that has already been worked out, such as one looked up in a NoteDelayMap. */
+    void glideDelay(size_t comb, float delayInSamples, size_t glideSamples) noexcept;
+    float getPitch(size_t comb) const noexcept { return pitchValues[comb]; }
+
+    /** setPitch() for a delay that has already been worked out, crossfading the same way. */
+    void setDelay(size_t comb, float delayInSamples, size_t fadeSamples = 0) noexcept;
+
+    /** Where the delay is heading, in samples and fractions of one. */
+    float getDelay(size_t comb) const noexcept { return delayTargets[comb]; }
+
+    /** Cutoff of the one-pole lowpass in the comb's feedback path. */
+    void setDampingCutoff(size_t comb, float cutoffHz) noexcept;
+    float getDampingCutoff(size_t comb) const noexcept { return dampingValues[comb]; }
+    float getDampingCoefficient(size_t comb) const noexcept { return dampingCoefficients[comb]; }
+
+    /** Picks the curve that keeps the feedback sum bounded. See Saturator for the error of each. */
+    void setSaturator(Saturator::Type newType) noexcept { saturatorType = newType; }
+    Saturator::Type getSaturator() const noexcept { return saturatorType; }
+
+    /** Picks how each tap blends the samples around it. See FractionalDelay for the trade-offs. */
+    void setInterpolation(FractionalDelay::Type newType) noexcept;
+    FractionalDelay::Type getInterpolation() const noexcept { return interpolationType; }
+
+    //==============================================================================
+    /** Adds the summed output of every active comb into wet, which has one row per channel. */
+    void process(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+private:
+    void processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+    template <size_t RegistersPerGroup>
+    void processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+    template <size_t RegistersPerGroup, Saturator::Type SaturatorType>
+    void processSegment(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+    template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+    void processChannels(const float* const* input, float* const* wet, size_t numChannels, size_t numSamples) noexcept;
+
+    template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+    void processPartition(size_t partition, size_t numPartitions, const float* const* input, float* const* wet,
+                          size_t numChannels, size_t numSamples) noexcept;
+
+    template <size_t RegistersPerGroup, Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType, bool Ramping>
+    void processLockstep(const size_t* groups, size_t numGroups, const float* const* input, float* const* wet,
+                         size_t numChannels, size_t numSamples) noexcept;
+
+    template <Saturator::Type SaturatorType, FractionalDelay::Type InterpolationType>
+    void processSlotBlock(size_t slot, const float* const* input, float* const* wet, size_t numChannels, size_t numSamples,
+                          float* delayed, float* dlineInput, float* reads) noexcept;
+
+    void startRamp(size_t comb, size_t rampSamples) noexcept;
+    void finishRamp(size_t comb) noexcept;
+    void advanceRamps(size_t numSamples) noexcept;
+    void clearComb(size_t comb) noexcept;
+
+    // whether the comb has a slot in the lanes right now
+    bool isPacked(size_t comb) const noexcept { return isActive(comb) && ! asleep[comb]; }
+    void wakeAll() noexcept;
+    void updateSleep(size_t numChannels, size_t numSamples) noexcept;
+
+    // a comb on its way out fades to silence whatever level it was set to
+    float getLevelTarget(size_t comb) const noexcept { return pendingActions[comb] == PendingAction::none ? levelTargets[comb] : 0.0f; }
+    void rebuildActiveList() noexcept;
+    void updateSlot(size_t slot) noexcept;
+    void updateGroupMinDelay(size_t group) noexcept;
+    void allocateDelayLines();
+    float* getAlignedArena() const noexcept;
+    float pitchToDelay(float frequencyHz) const noexcept;
+
+    DelayLine& getDelayLine(size_t comb, size_t ch) noexcept { return delayLines[comb * maxNumChannels + ch]; }
+
+    // from the lanes while the comb is packed, and from where rebuildActiveList() parked it otherwise
+    float getStatePeak(const std::vector<Lanes>& packed, const std::vector<float>& saved, size_t comb) const noexcept;
+
+    //==============================================================================
+    static constexpr size_t inactive = std::numeric_limits<size_t>::max();
+
+    // what happens to a comb once its output has faded out
+    enum class PendingAction : uint8_t
+    {
+        none,
+        deactivate,
+        restart
+    };
+    static constexpr size_t cacheLineFloats = 64 / sizeof(float);
+
+    size_t numCombs = 0, maxDelaySamples = 0, maxBlockSize = 1;
+    size_t numPreparedChannels = 2; // stereo until prepare() says otherwise
+    double sampleRate = 44.1e3;
+    Saturator::Type saturatorType = Saturator::Type::rational;
+    FractionalDelay::Type interpolationType = FractionalDelay::Type::lagrange3;
+
+    // one allocation holds every ring buffer, comb by comb and channel by channel,
+    // with each line starting on its own cache line
+    juce::HeapBlock<float> arena;
+    size_t arenaSize = 0;
+
+    // per-comb values as set by the caller, indexed by comb
+    std::vector<float> feedbackValues, levelValues, pitchValues, dampingValues, dampingCoefficients;
+    std::vector<float> delayTimes;
+    std::vector<size_t> combSlots;
+    std::vector<DelayLine> delayLines;
+    std::vector<float> savedDampingState, savedTapState;
+
+    // how long each awake comb's line writes have stayed under sleepThreshold, counted only
+    // through silent input
+    std::vector<char> asleep;
+    std::vector<size_t> quietSamples;
+    size_t numAsleep = 0;
+
+    // where a ramping comb is heading and how many samples it has left to get there.
+    // rampingCombs is reserved for the whole bank, so starting a ramp never allocates.
+    // Input gain and tap mix always head for 1, and a comb fading out heads for a level of 0
+    std::vector<float> feedbackTargets, levelTargets, delayTargets, inputGainValues, tapMixValues;
+    std::vector<size_t> rampRemaining, rampingCombs;
+
+    // a pitch crossfade reads the old tap as well until the mix reaches 1, whole samples being
+    // plenty for something on its way out
+    std::vector<size_t> previousDelayTimes, fadeLengths;
+    std::vector<PendingAction> pendingActions;
+
+    // the active combs packed into lanes, indexed by slot. Slots past the last active comb
+    // are padding that reads and writes an always-silent line and contributes nothing
+    std::vector<size_t> activeCombs;
+    size_t numActiveRegisters = 0, registersPerGroup = 1;
+    std::array<std::vector<DelayLine*>, maxNumChannels> slotLines;
+    std::vector<size_t> slotTaps, slotPreviousDelays;
+    std::array<DelayLine, maxNumChannels> paddingLines;
+
+    // per group, the nearest sample its real combs read decides which path the group takes,
+    // except that a group with a ramping comb always runs in lockstep
+    std::vector<size_t> groupMinDelays, blockGroups, lockstepGroups;
+    std::vector<char> rampingGroups;
+    size_t numBlockGroups = 0, numLockstepGroups = 0;
+
+    // one block of scratch per partition, and a partial wet sum for every partition but the first
+    WorkerPool* pool = nullptr;
+    size_t numPartitions = 1;
+    std::vector<float> blockDelayed, blockFeedback, blockReads, partialWet;
+
+    std::vector<Lanes> feedback, level, inputGain, damping;
+
+    std::vector<Lanes> tapMix;
+
+    // the fractional delay, and what the interpolation blends with at its current tap.
+    // A gliding comb works both out again every sample
+    std::vector<Lanes> tapDelay, tapCoefficient;
+
+    // per-sample increments while a comb is ramping, zero otherwise
+    std::vector<Lanes> feedbackStep, levelStep, inputGainStep, tapMixStep, tapDelayStep;
+
+    // interleaved by channel, register by register, so all channels of a group sit together.
+    // Only the thiran allpass uses tapState
+    std::vector<Lanes> dampingState, tapState;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CombBank)
+};
@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    CombResponse.cpp
+
+  ==============================================================================
+*/
+
+#include "CombResponse.h"
+
+//==============================================================================
+CombResponse::CombResponse(size_t numCombs)
+    : combs(numCombs),
+      omega((size_t) numPoints), cosOmega((size_t) numPoints), sinOmega((size_t) numPoints),
+      phase((size_t) numPoints), cosPhase((size_t) numPoints), sinPhase((size_t) numPoints),
+      sumReal((size_t) numPoints), sumImag((size_t) numPoints)
+{
+    for (auto& c : combs)
+    {
+        c.real.assign((size_t) numPoints, 0.0f);
+        c.imag.assign((size_t) numPoints, 0.0f);
+    }
+
+    setSampleRate(sampleRate);
+}
+
+float CombResponse::getFrequency(int point) noexcept
+{
+    return minFrequency * std::pow(maxFrequency / minFrequency, (float) point / (float) (numPoints - 1));
+}
+
+void CombResponse::setSampleRate(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+
+    for (int point = 0; point < numPoints; ++point)
+    {
+        auto w = juce::MathConstants<double>::twoPi * (double) getFrequency(point) / sampleRate;
+        omega[(size_t) point] = (float) w;
+        cosOmega[(size_t) point] = (float) std::cos(w);
+        sinOmega[(size_t) point] = (float) std::sin(w);
+    }
+
+    for (size_t comb = 0; comb < combs.size(); ++comb)
+        computeComb(comb);
+
+    resum();
+}
+
+//==============================================================================
+bool CombResponse::setComb(size_t comb, const Settings& settings)
+{
+    auto& c = combs[comb];
+    if (settings == c.settings) return false;
+
+    // an inactive comb isn't in the sum, so its curve only needs working out for its own display
+    if (c.settings.active)
+        addToSum(comb, -1.0);
+
+    c.settings = settings;
+    computeComb(comb);
+
+    if (c.settings.active)
+        addToSum(comb, 1.0);
+
+    numActive = (size_t) std::count_if(combs.begin(), combs.end(), [](const Comb& other) { return other.settings.active; });
+
+    if (++updatesSinceResum >= updatesBetweenResums)
+        resum();
+
+    return true;
+}
+
+void CombResponse::computeComb(size_t comb) noexcept
+{
+    auto& c = combs[comb];
+    auto& s = c.settings;
+
+    if (s.pitchHz <= 0.0f || s.level == 0.0f)
+    {
+        std::fill(c.real.begin(), c.real.end(), 0.0f);
+        std::fill(c.imag.begin(), c.imag.end(), 0.0f);
+        return;
+    }
+
+    // the bank interpolates between samples, so the teeth sit at the exact pitch
+    auto delay = juce::jmax(FractionalDelay::minDelay, (float) (sampleRate / (double) s.pitchHz));
+    auto a = s.dampingHz > 0.0f ? DampingFilter::coefficientFor((double) s.dampingHz, sampleRate) : 1.0f;
+    auto b = 1.0f - a;
+    auto fb = s.feedback, lv = s.level;
+
+    // the phases run to thousands of radians, too far out for the fast approximations
+    juce::FloatVectorOperations::copyWithMultiply(phase.data(), omega.data(), delay, numPoints);
+
+    for (size_t i = 0; i < (size_t) numPoints; ++i)
+    {
+        cosPhase[i] = std::cos(phase[i]);
+        sinPhase[i] = std::sin(phase[i]);
+    }
+
+    // split real and imaginary arrays with no branches, so the compiler vectorises the complex maths
+    auto* re = c.real.data();
+    auto* im = c.imag.data();
+
+    for (size_t i = 0; i < (size_t) numPoints; ++i)
+    {
+        // D = a / (1 - b e^-jw)
+        auto dDenReal = 1.0f - b * cosOmega[i];
+        auto dDenImag = b * sinOmega[i];
+        auto dScale = a / (dDenReal * dDenReal + dDenImag * dDenImag);
+        auto dReal = dDenReal * dScale;
+        auto dImag = -dDenImag * dScale;
+
+        // G = D e^-jwN
+        auto gReal = dReal * cosPhase[i] + dImag * sinPhase[i];
+        auto gImag = dImag * cosPhase[i] - dReal * sinPhase[i];
+
+        // H = level G / (1 - feedback G)
+        auto hDenReal = 1.0f - fb * gReal;
+        auto hDenImag = -fb * gImag;
+        auto hScale = lv / (hDenReal * hDenReal + hDenImag * hDenImag);
+
+        re[i] = (gReal * hDenReal + gImag * hDenImag) * hScale;
+        im[i] = (gImag * hDenReal - gReal * hDenImag) * hScale;
+    }
+}
+
+void CombResponse::addToSum(size_t comb, double sign) noexcept
+{
+    auto& c = combs[comb];
+
+    for (size_t i = 0; i < (size_t) numPoints; ++i)
+    {
+        sumReal[i] += sign * (double) c.real[i];
+        sumImag[i] += sign * (double) c.imag[i];
+    }
+}
+
+void CombResponse::resum() noexcept
+{
+    std::fill(sumReal.begin(), sumReal.end(), 0.0);
+    std::fill(sumImag.begin(), sumImag.end(), 0.0);
+
+    for (size_t comb = 0; comb < combs.size(); ++comb)
+        if (combs[comb].settings.active)
+            addToSum(comb, 1.0);
+
+    updatesSinceResum = 0;
+}
+
+//==============================================================================
+void CombResponse::getCombDecibels(size_t comb, float* decibels, float floorDecibels) const noexcept
+{
+    auto& c = combs[comb];
+    auto floorPower = std::pow(10.0f, floorDecibels / 10.0f);
+
+    for (size_t i = 0; i < (size_t) numPoints; ++i)
+        decibels[i] = 10.0f * std::log10(juce::jmax(floorPower, c.real[i] * c.real[i] + c.imag[i] * c.imag[i]));
+}
+
+void CombResponse::getOutputDecibels(float* decibels, float wet, float gain, float floorDecibels) const noexcept
+{
+    auto floorPower = std::pow(10.0f, floorDecibels / 10.0f);
+    auto wetScale = numActive > 0 ? (double) wet / (double) numActive : 0.0;
+    auto dry = 1.0 - (double) wet;
+
+    for (size_t i = 0; i < (size_t) numPoints; ++i)
+    {
+        auto re = gain * (dry + wetScale * sumReal[i]);
+        auto im = gain * wetScale * sumImag[i];
+        decibels[i] = 10.0f * std::log10(juce::jmax(floorPower, (float) (re * re + im * im)));
+    }
+}
@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    CombResponse.h
+    Analytic frequency response of each comb and of the bank as a whole.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "DampingFilter.h"
+#include "FractionalDelay.h"
+
+//==============================================================================
+/**
+    Each comb feeds its delayed, damped output back into its own line and mixes it out at its level,
+    so apart from the saturator it is linear with
+
+        H(z) = level * G(z) / (1 - feedback * G(z)),    G(z) = D(z) z^-delay,    D(z) = a / (1 - (1 - a) z^-1)
+
+    which is evaluated on a grid of numPoints log-spaced frequencies. Every comb's complex response
+    is kept, and so is their sum, so changing one comb costs one comb's worth of maths however
+    large the bank is: its old curve comes out of the sum and the new one goes in.
+*/
+class CombResponse
+{
+public:
+    static constexpr int numPoints = 512;
+    static constexpr float minFrequency = 20.0f, maxFrequency = 20000.0f;
+
+    struct Settings
+    {
+        float pitchHz = 0.0f, feedback = 0.0f, level = 0.0f, dampingHz = 0.0f;
+        bool active = false;
+
+        bool operator== (const Settings& other) const noexcept
+        {
+            return pitchHz == other.pitchHz && feedback == other.feedback && level == other.level
+                && dampingHz == other.dampingHz && active == other.active;
+        }
+
+        bool operator!= (const Settings& other) const noexcept { return ! operator== (other); }
+    };
+
+    explicit CombResponse(size_t numCombs);
+
+    /** Moves the grid and recomputes every comb, since each one's delay in samples depends on the rate. */
+    void setSampleRate(double newSampleRate);
+    double getSampleRate() const noexcept { return sampleRate; }
+
+    size_t getNumCombs() const noexcept { return combs.size(); }
+    size_t getNumActiveCombs() const noexcept { return numActive; }
+
+    /** Recomputes the comb and updates the bank's sum if anything changed, and returns whether it did. */
+    bool setComb(size_t comb, const Settings& settings);
+    const Settings& getComb(size_t comb) const noexcept { return combs[comb].settings; }
+
+    /** The frequency of a grid point, from minFrequency at 0 to maxFrequency at numPoints - 1. */
+    static float getFrequency(int point) noexcept;
+
+    /** One comb's gain in decibels at every grid point, no lower than floorDecibels. */
+    void getCombDecibels(size_t comb, float* decibels, float floorDecibels) const noexcept;
+
+    /** The whole output the way the processor mixes it, gain * ((1 - wet) + wet * sum / numActive). */
+    void getOutputDecibels(float* decibels, float wet, float gain, float floorDecibels) const noexcept;
+
+private:
+    void computeComb(size_t comb) noexcept;
+    void addToSum(size_t comb, double sign) noexcept;
+    void resum() noexcept;
+
+    // incremental updates drift by a rounding error each, so after this many the sum starts over
+    static constexpr int updatesBetweenResums = 256;
+
+    struct Comb
+    {
+        Settings settings;
+        std::vector<float> real, imag;
+    };
+
+    double sampleRate = 44.1e3;
+    std::vector<Comb> combs;
+    size_t numActive = 0;
+    int updatesSinceResum = 0;
+
+    // the grid, as radians per sample and the unit delay at each point
+    std::vector<float> omega, cosOmega, sinOmega;
+
+    // scratch for one comb at a time, then the running sum of every active one
+    std::vector<float> phase, cosPhase, sinPhase;
+    std::vector<double> sumReal, sumImag;
+
+    JUCE_DECLARE_NON_COPYABLE(CombResponse)
+};
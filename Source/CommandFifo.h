@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    CommandFifo.h
+    Wait-free single-producer, single-consumer queue of small commands.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    One thread pushes, one other thread drains, and neither ever locks or allocates.
+    Commands are copied in and out by value, so they should be small and trivially copyable.
+*/
+template <typename Command, int capacity>
+class CommandFifo
+{
+public:
+    static_assert(std::is_trivially_copyable_v<Command>, "commands are copied between threads byte for byte");
+
+    CommandFifo() = default;
+
+    /** Returns false and drops the command if the consumer has fallen a whole queue behind. */
+    bool push(const Command& command) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+            return false;
+
+        commands[(size_t) (size1 > 0 ? start1 : start2)] = command;
+        fifo.finishedWrite(1);
+        return true;
+    }
+
+    /** Hands every command pushed so far to the handler, oldest first. */
+    template <typename Handler>
+    void drain(Handler&& handler) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+        for (int i = 0; i < size1; ++i) handler(commands[(size_t) (start1 + i)]);
+        for (int i = 0; i < size2; ++i) handler(commands[(size_t) (start2 + i)]);
+
+        fifo.finishedRead(size1 + size2);
+    }
+
+private:
+    juce::AbstractFifo fifo { capacity };
+    std::array<Command, (size_t) capacity> commands {};
+
+    JUCE_DECLARE_NON_COPYABLE(CommandFifo)
+};
@@ -0,0 +1,44 @@
+/*
+  ==============================================================================
+
+    DampingFilter.h
+    One-pole lowpass for the comb feedback path.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    y[n] = y[n-1] + a * (x[n] - y[n-1]), one coefficient and one state value per comb and channel.
+    The kernels are templated on the sample type, so the same code runs on a float or on a
+    SIMDRegister holding one comb per lane.
+*/
+struct DampingFilter
+{
+    /** Places the pole where the analogue one-pole would be, so the -3 dB point sits at cutoffHz. */
+    static float coefficientFor(double cutoffHz, double sampleRate) noexcept
+    {
+        jassert(cutoffHz > 0.0 && sampleRate > 0.0);
+        return (float) (1.0 - std::exp(-juce::MathConstants<double>::twoPi * cutoffHz / sampleRate));
+    }
+
+    template <typename SampleType>
+    static SampleType processSample(SampleType x, SampleType& state, SampleType coefficient) noexcept
+    {
+        state = state + coefficient * (x - state);
+        return state;
+    }
+
+    /** Filters a block in place and returns the updated state. */
+    static float processBlock(float* samples, size_t numSamples, float state, float coefficient) noexcept
+    {
+        for (size_t i = 0; i < numSamples; ++i)
+            samples[i] = processSample(samples[i], state, coefficient);
+
+        return state;
+    }
+};
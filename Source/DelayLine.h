@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    DelayLine.h
+    A power-of-two ring buffer with masked wrapping and block read/write spans.
+    The samples themselves live in memory owned by whoever sets up the line.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+class DelayLine
+{
+public:
+    // a block read or write wraps around the end of the buffer at most once,
+    // so it always comes back as one or two contiguous runs of samples
+    struct Span
+    {
+        float* data = nullptr;
+        size_t size = 0;
+    };
+
+    struct SpanPair
+    {
+        Span first, second;
+    };
+
+    // rounds up to a power of two, so wrapping an index is a mask instead of a %
+    static size_t capacityFor(size_t minimumSize) noexcept
+    {
+        return (size_t) juce::nextPowerOfTwo((int) juce::jmax(minimumSize, (size_t) 1));
+    }
+
+    // points the line at capacity samples of someone else's memory and clears them
+    void setStorage(float* newData, size_t newCapacity) noexcept
+    {
+        jassert(newCapacity == capacityFor(newCapacity));
+        rawData = newData;
+        capacity = newCapacity;
+        mask = newCapacity - 1;
+        writeIndex = 0;
+        clear();
+    }
+
+    void clear() noexcept { juce::FloatVectorOperations::clear(rawData, (int) capacity); }
+
+    size_t size() const noexcept { return capacity; }
+
+    // delays count back from the write head, so a delay of 1 is the most recently pushed sample
+    float back() const noexcept { return rawData[writeIndex]; }
+
+    float get(size_t delayInSamples) const noexcept
+    {
+        jassert(delayInSamples >= 1 && delayInSamples <= size());
+        return rawData[(writeIndex - delayInSamples) & mask];
+    }
+
+    void set(size_t delayInSamples, float newValue) noexcept
+    {
+        jassert(delayInSamples >= 1 && delayInSamples <= size());
+        rawData[(writeIndex - delayInSamples) & mask] = newValue;
+    }
+
+    void push(float valueToAdd) noexcept
+    {
+        rawData[writeIndex] = valueToAdd;
+        writeIndex = (writeIndex + 1) & mask;
+    }
+
+    // numSamples samples starting delayInSamples behind the write head. If numSamples <= delayInSamples
+    // every one of them was written before the block started, so the block can be read in one go
+    SpanPair getReadSpans(size_t delayInSamples, size_t numSamples) noexcept
+    {
+        jassert(numSamples <= delayInSamples && delayInSamples <= size());
+        return makeSpans((writeIndex - delayInSamples) & mask, numSamples);
+    }
+
+    // the next numSamples slots at the write head; call advance() once they have been filled
+    SpanPair getWriteSpans(size_t numSamples) noexcept
+    {
+        jassert(numSamples <= size());
+        return makeSpans(writeIndex, numSamples);
+    }
+
+    void advance(size_t numSamples) noexcept { writeIndex = (writeIndex + numSamples) & mask; }
+
+    // the largest magnitude among the numSamples most recently pushed
+    float getRecentPeak(size_t numSamples) const noexcept
+    {
+        jassert(numSamples <= size());
+        auto spans = makeSpans((writeIndex - numSamples) & mask, numSamples);
+        auto first = juce::FloatVectorOperations::findMinAndMax(spans.first.data, (int) spans.first.size);
+        auto second = juce::FloatVectorOperations::findMinAndMax(spans.second.data, (int) spans.second.size);
+
+        return juce::jmax(-first.getStart(), first.getEnd(), -second.getStart(), second.getEnd());
+    }
+
+    void read(size_t delayInSamples, float* dest, size_t numSamples) noexcept
+    {
+        auto spans = getReadSpans(delayInSamples, numSamples);
+        juce::FloatVectorOperations::copy(dest, spans.first.data, (int) spans.first.size);
+        juce::FloatVectorOperations::copy(dest + spans.first.size, spans.second.data, (int) spans.second.size);
+    }
+
+    void write(const float* source, size_t numSamples) noexcept
+    {
+        auto spans = getWriteSpans(numSamples);
+        juce::FloatVectorOperations::copy(spans.first.data, source, (int) spans.first.size);
+        juce::FloatVectorOperations::copy(spans.second.data, source + spans.first.size, (int) spans.second.size);
+        advance(numSamples);
+    }
+
+private:
+    SpanPair makeSpans(size_t startIndex, size_t numSamples) const noexcept
+    {
+        auto firstSize = juce::jmin(numSamples, size() - startIndex);
+        return { { rawData + startIndex, firstSize },
+                 { rawData, numSamples - firstSize } };
+    }
+
+    float* rawData = nullptr;
+    size_t capacity = 0, mask = 0;
+    size_t writeIndex = 0;
+};
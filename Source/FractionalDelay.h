@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    FractionalDelay.h
+    Reading a delay line between samples, for combs tuned finer than a whole sample.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    A comb's period is rarely a whole number of samples. B5 at 44.1 kHz is 44.65 samples, and
+    rounding it to 45 leaves the comb 13 cents flat. Each type splits the delay into a whole-sample
+    tap and a fraction, then reads the line around that tap and blends the reads:
+
+        linear     tap and tap + 1. Cheapest, but the blend is a lowpass that deepens towards half
+                   a sample, so how fast the top of a comb decays depends on its pitch
+        lagrange3  tap - 1 to tap + 2 with third-order Lagrange weights. Close to flat well up the
+                   spectrum and fine to move every sample, so it is the default
+        thiran     a first-order allpass over tap and tap + 1. Flat at any fraction, but it keeps a
+                   state per comb and channel, and a delay moving quickly disturbs it
+
+    The kernels are templated on the sample type like DampingFilter's, so the same code blends one
+    comb as a float or a register of combs as a SIMDRegister.
+*/
+struct FractionalDelay
+{
+    enum class Type
+    {
+        linear,
+        lagrange3,
+        thiran
+    };
+
+    // lagrange3 reads a sample ahead of its tap, which must still be one that has been written
+    static constexpr float minDelay = 2.0f;
+
+    // the furthest any type reads past the delay itself, and the most samples any type blends
+    static constexpr size_t maxReadsPastDelay = 2;
+    static constexpr size_t maxNumReads = 4;
+
+    template <Type type> static constexpr size_t numReads = type == Type::lagrange3 ? 4 : 2;
+    template <Type type> static constexpr size_t readsBeforeTap = type == Type::lagrange3 ? 1 : 0;
+
+    struct Split
+    {
+        size_t tap;
+        float fraction;
+    };
+
+    template <Type type>
+    static Split split(float delay) noexcept
+    {
+        // the allpass is most accurate making up between half a sample and one and a half
+        auto whole = std::floor(type == Type::thiran ? delay - 0.5f : delay);
+        return { (size_t) whole, delay - whole };
+    }
+
+    /** What interpolate() blends with: the fraction itself, or for thiran the allpass coefficient. */
+    template <Type type>
+    static float coefficientFor(float fraction) noexcept
+    {
+        if constexpr (type == Type::thiran)
+            return (1.0f - fraction) / (1.0f + fraction);
+        else
+            return fraction;
+    }
+
+    static Split split(Type type, float delay) noexcept
+    {
+        switch (type)
+        {
+            case Type::linear:    return split<Type::linear>(delay);
+            case Type::lagrange3: return split<Type::lagrange3>(delay);
+            case Type::thiran:    break;
+        }
+
+        return split<Type::thiran>(delay);
+    }
+
+    static float coefficientFor(Type type, float fraction) noexcept
+    {
+        return type == Type::thiran ? coefficientFor<Type::thiran>(fraction) : fraction;
+    }
+
+    static size_t getReadsBeforeTap(Type type) noexcept { return type == Type::lagrange3 ? 1 : 0; }
+
+    /** The most a blend can come out above the largest sample it reads: the largest sum of absolute
+        weights, 1.25 for lagrange3 halfway between samples, and for thiran the sum of its impulse
+        response, 1 + 2|a| with |a| at most 1/3. Only thiran's state can add to that.
+    */
+    static float getMaxGain(Type type) noexcept
+    {
+        switch (type)
+        {
+            case Type::linear:    return 1.0f;
+            case Type::lagrange3: return 1.25f;
+            case Type::thiran:    break;
+        }
+
+        return 5.0f / 3.0f;
+    }
+
+    //==============================================================================
+    /** reads[k] is the line tap - readsBeforeTap + k samples back. Only thiran touches state. */
+    template <Type type, typename SampleType>
+    static SampleType interpolate(const SampleType* reads, SampleType coefficient, SampleType& state) noexcept
+    {
+        if constexpr (type == Type::linear)
+        {
+            juce::ignoreUnused(state);
+            return reads[0] + (reads[1] - reads[0]) * coefficient;
+        }
+        else if constexpr (type == Type::lagrange3)
+        {
+            // the weights for nodes at -1, 0, 1 and 2 samples from the tap, sharing their products
+            juce::ignoreUnused(state);
+            auto& d = coefficient;
+            auto below = (d - 1.0f) * (d - 2.0f);
+            auto above = (d + 1.0f) * d;
+
+            return reads[0] * (d * below * (-1.0f / 6.0f))
+                 + reads[1] * ((d + 1.0f) * below * 0.5f)
+                 + reads[2] * (above * (d - 2.0f) * -0.5f)
+                 + reads[3] * (above * (d - 1.0f) * (1.0f / 6.0f));
+        }
+        else
+        {
+            // y[n] = a x[n] + x[n-1] - a y[n-1], where x[n-1] is simply the next sample back
+            state = coefficient * (reads[0] - state) + reads[1];
+            return state;
+        }
+    }
+
+    /** Blends a block whose reads all come from before it started. source holds the
+        numSamples + numReads - 1 samples from the furthest read onwards, oldest first.
+        Returns the updated state.
+    */
+    template <Type type>
+    static float processBlock(const float* source, float* dest, size_t numSamples, float coefficient, float state) noexcept
+    {
+        // sample i's read k sits at source[i + numReads - 1 - k]
+        if constexpr (type == Type::linear)
+        {
+            juce::FloatVectorOperations::copyWithMultiply(dest, source + 1, 1.0f - coefficient, (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply(dest, source, coefficient, (int) numSamples);
+        }
+        else if constexpr (type == Type::lagrange3)
+        {
+            float weights[4];
+            float reads[4];
+
+            // each weight is the blend of a unit impulse at its node
+            for (size_t k = 0; k < 4; ++k)
+            {
+                std::fill(std::begin(reads), std::end(reads), 0.0f);
+                reads[k] = 1.0f;
+                weights[k] = interpolate<type>(reads, coefficient, state);
+            }
+
+            juce::FloatVectorOperations::copyWithMultiply(dest, source + 3, weights[0], (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply(dest, source + 2, weights[1], (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply(dest, source + 1, weights[2], (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply(dest, source, weights[3], (int) numSamples);
+        }
+        else
+        {
+            // the allpass is a recurrence, so like the damping filter it stays sample by sample
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const float reads[] = { source[i + 1], source[i] };
+                dest[i] = interpolate<type>(reads, coefficient, state);
+            }
+        }
+
+        return state;
+    }
+};
@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    LoadMeter.h
+    Lock-free histogram of how much of each block's time budget processing used.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Load is the time processBlock() took over the time the block lasts, samplesPerBlock / sampleRate,
+    so anything above 1 missed the deadline. The audio thread is the only writer and every value it
+    writes is a single atomic, so the editor reads whenever it likes without either side locking.
+*/
+class LoadMeter
+{
+public:
+    static constexpr int numBins = 40;
+    static constexpr float binWidth = 0.05f; // so the last bin holds everything from 195% up
+
+    LoadMeter() = default;
+
+    /** Call from prepareToPlay(), never while processing. */
+    void prepare(double sampleRate) noexcept
+    {
+        secondsPerSample = 1.0 / sampleRate;
+        reset();
+    }
+
+    /** Asks the audio thread to start counting afresh at its next block. */
+    void reset() noexcept { resetRequested.store(true); }
+
+    void addBlock(double seconds, int numSamples) noexcept
+    {
+        if (resetRequested.exchange(false))
+        {
+            for (auto& bin : bins)
+                bin.store(0, std::memory_order_relaxed);
+
+            peak.store(0.0f, std::memory_order_relaxed);
+            overruns.store(0, std::memory_order_relaxed);
+        }
+
+        if (numSamples <= 0) return;
+
+        auto load = (float) (seconds / (numSamples * secondsPerSample));
+        auto bin = juce::jmin(numBins - 1, (int) (load / binWidth));
+
+        bins[(size_t) bin].fetch_add(1, std::memory_order_relaxed);
+        latest.store(load, std::memory_order_relaxed);
+
+        if (load > peak.load(std::memory_order_relaxed))
+            peak.store(load, std::memory_order_relaxed);
+
+        if (load > 1.0f)
+            overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Times its own lifetime, so one at the top of processBlock() covers the whole block. */
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(LoadMeter& m, int blockSamples) noexcept
+            : meter(m), numSamples(blockSamples), start(juce::Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            meter.addBlock(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start), numSamples);
+        }
+
+    private:
+        LoadMeter& meter;
+        int numSamples;
+        juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedTimer)
+    };
+
+    //==============================================================================
+    float getLatestLoad() const noexcept        { return latest.load(std::memory_order_relaxed); }
+    float getPeakLoad() const noexcept          { return peak.load(std::memory_order_relaxed); }
+    juce::uint32 getNumOverruns() const noexcept { return overruns.load(std::memory_order_relaxed); }
+
+    std::array<juce::uint32, numBins> getHistogram() const noexcept
+    {
+        std::array<juce::uint32, numBins> counts;
+
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] = bins[i].load(std::memory_order_relaxed);
+
+        return counts;
+    }
+
+    /** The load that this fraction of blocks stayed under, to the resolution of one bin. */
+    static float getPercentile(const std::array<juce::uint32, numBins>& counts, float fraction) noexcept
+    {
+        auto total = std::accumulate(counts.begin(), counts.end(), (juce::uint64) 0);
+        auto threshold = (juce::uint64) std::ceil((double) fraction * (double) total);
+        juce::uint64 running = 0;
+
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            running += counts[i];
+
+            if (total > 0 && running >= threshold)
+                return (float) (i + 1) * binWidth;
+        }
+
+        return 0.0f;
+    }
+
+private:
+    double secondsPerSample = 1.0 / 44100.0;
+
+    std::array<std::atomic<juce::uint32>, numBins> bins {};
+    std::atomic<float> latest { 0.0f }, peak { 0.0f };
+    std::atomic<juce::uint32> overruns { 0 };
+    std::atomic<bool> resetRequested { false };
+
+    JUCE_DECLARE_NON_COPYABLE(LoadMeter)
+};
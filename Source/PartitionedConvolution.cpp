@@ -0,0 +1,274 @@
+/*
+  ==============================================================================
+
+    PartitionedConvolution.cpp
+
+  ==============================================================================
+*/
+
+#include "PartitionedConvolution.h"
+
+namespace
+{
+    // JUCE's real-only transforms work in place on twice the transform size
+    std::unique_ptr<juce::dsp::FFT> createFFT(size_t partitionSize)
+    {
+        jassert(juce::isPowerOfTwo(partitionSize));
+        return std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2((double) partitionSize * 2.0)));
+    }
+
+    /** Transforms length samples zero padded to the FFT size, keeping bins 0 to size / 2 as split arrays. */
+    void forward(juce::dsp::FFT& fft, float* scratch, const float* samples, size_t length, float* real, float* imag) noexcept
+    {
+        auto size = (size_t) fft.getSize();
+
+        juce::FloatVectorOperations::copy(scratch, samples, (int) length);
+        juce::FloatVectorOperations::clear(scratch + length, (int) (size * 2 - length));
+        fft.performRealOnlyForwardTransform(scratch, true);
+
+        for (size_t bin = 0; bin <= size / 2; ++bin)
+        {
+            real[bin] = scratch[bin * 2];
+            imag[bin] = scratch[bin * 2 + 1];
+        }
+    }
+
+    /** The other way, leaving size real samples at the start of scratch. */
+    void inverse(juce::dsp::FFT& fft, float* scratch, const float* real, const float* imag) noexcept
+    {
+        auto size = (size_t) fft.getSize();
+
+        for (size_t bin = 0; bin <= size / 2; ++bin)
+        {
+            scratch[bin * 2] = real[bin];
+            scratch[bin * 2 + 1] = imag[bin];
+        }
+
+        // not every FFT engine ignores the mirrored half, so it is filled in for the ones that read it
+        for (size_t bin = size / 2 + 1; bin < size; ++bin)
+        {
+            scratch[bin * 2] = real[size - bin];
+            scratch[bin * 2 + 1] = -imag[size - bin];
+        }
+
+        fft.performRealOnlyInverseTransform(scratch);
+    }
+
+    void multiplyAdd(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                     float* sumReal, float* sumImag, size_t numBins) noexcept
+    {
+        for (size_t bin = 0; bin < numBins; ++bin)
+        {
+            sumReal[bin] += aReal[bin] * bReal[bin] - aImag[bin] * bImag[bin];
+            sumImag[bin] += aReal[bin] * bImag[bin] + aImag[bin] * bReal[bin];
+        }
+    }
+}
+
+//==============================================================================
+void PartitionedConvolution::Impulse::allocate(size_t newPartitionSize, size_t maxPartitions)
+{
+    jassert(newPartitionSize >= shortPartitionSize && maxPartitions > 0);
+    partitionSize = newPartitionSize;
+    numBins = partitionSize + 1;
+    numPartitions = numShortPartitions = 0;
+
+    fft = createFFT(partitionSize);
+    shortFFT = createFFT(shortPartitionSize);
+    scratch.assign(partitionSize * 4, 0.0f);
+    head.assign(shortPartitionSize, 0.0f);
+
+    // the first partition is the head and the short partitions, so it has no spectrum of its own
+    real.assign((maxPartitions - 1) * numBins, 0.0f);
+    imag.assign((maxPartitions - 1) * numBins, 0.0f);
+
+    auto maxShortPartitions = partitionSize / shortPartitionSize - 1;
+    shortReal.assign(maxShortPartitions * (shortPartitionSize + 1), 0.0f);
+    shortImag.assign(maxShortPartitions * (shortPartitionSize + 1), 0.0f);
+}
+
+bool PartitionedConvolution::Impulse::set(const float* response, size_t length)
+{
+    jassert(fft != nullptr);
+
+    auto needed = (length + partitionSize - 1) / partitionSize;
+    if (needed > 1 && (needed - 1) * numBins > real.size())
+    {
+        numPartitions = 0;
+        return false;
+    }
+
+    std::fill(head.begin(), head.end(), 0.0f);
+    std::copy_n(response, juce::jmin(length, shortPartitionSize), head.begin());
+
+    // only the short partitions the response reaches are kept, so a short impulse skips the rest
+    auto firstLength = juce::jmin(length, partitionSize);
+    numShortPartitions = firstLength > shortPartitionSize ? (firstLength - 1) / shortPartitionSize : 0;
+
+    for (size_t partition = 0; partition < numShortPartitions; ++partition)
+    {
+        auto start = (partition + 1) * shortPartitionSize;
+        forward(*shortFFT, scratch.data(), response + start, juce::jmin(shortPartitionSize, firstLength - start),
+                shortReal.data() + partition * (shortPartitionSize + 1), shortImag.data() + partition * (shortPartitionSize + 1));
+    }
+
+    for (size_t partition = 1; partition < needed; ++partition)
+    {
+        auto start = partition * partitionSize;
+        forward(*fft, scratch.data(), response + start, juce::jmin(partitionSize, length - start),
+                real.data() + (partition - 1) * numBins, imag.data() + (partition - 1) * numBins);
+    }
+
+    numPartitions = needed;
+    return true;
+}
+
+//==============================================================================
+void PartitionedConvolution::prepare(size_t newPartitionSize, size_t newMaxPartitions, size_t numChannels)
+{
+    jassert(newPartitionSize >= shortPartitionSize);
+    partitionSize = newPartitionSize;
+    numBins = partitionSize + 1;
+    numShortBins = shortPartitionSize + 1;
+    maxPartitions = juce::jmax(newMaxPartitions, (size_t) 1);
+    shortRingSize = partitionSize / shortPartitionSize - 1;
+
+    fft = createFFT(partitionSize);
+    shortFFT = createFFT(shortPartitionSize);
+    scratch.assign(partitionSize * 4, 0.0f);
+    outputReal.assign(numBins, 0.0f);
+    outputImag.assign(numBins, 0.0f);
+
+    channels.resize(numChannels);
+    for (auto& c : channels)
+    {
+        c.shortInput.assign(shortPartitionSize * 2, 0.0f);
+        c.input.assign(partitionSize, 0.0f);
+
+        c.shortStage.output.assign(shortPartitionSize, 0.0f);
+        c.shortStage.overlap.assign(shortPartitionSize, 0.0f);
+        c.shortStage.historyReal.assign(shortRingSize * numShortBins, 0.0f);
+        c.shortStage.historyImag.assign(shortRingSize * numShortBins, 0.0f);
+
+        c.stage.output.assign(partitionSize, 0.0f);
+        c.stage.overlap.assign(partitionSize, 0.0f);
+        c.stage.historyReal.assign((maxPartitions - 1) * numBins, 0.0f);
+        c.stage.historyImag.assign((maxPartitions - 1) * numBins, 0.0f);
+    }
+
+    reset(maxPartitions);
+}
+
+void PartitionedConvolution::reset(size_t numPartitions) noexcept
+{
+    // the first partition has no place in the ring, since it only ever meets the current block
+    ringSize = juce::jlimit((size_t) 1, maxPartitions, numPartitions) - 1;
+    shortPosition = inputPosition = 0;
+
+    // only the part of the ring in use has to be cleared
+    for (auto& c : channels)
+    {
+        std::fill(c.shortInput.begin(), c.shortInput.end(), 0.0f);
+        std::fill(c.input.begin(), c.input.end(), 0.0f);
+
+        for (auto* stage : { &c.shortStage, &c.stage })
+        {
+            std::fill(stage->output.begin(), stage->output.end(), 0.0f);
+            std::fill(stage->overlap.begin(), stage->overlap.end(), 0.0f);
+            stage->newest = 0;
+        }
+
+        std::fill(c.shortStage.historyReal.begin(), c.shortStage.historyReal.end(), 0.0f);
+        std::fill(c.shortStage.historyImag.begin(), c.shortStage.historyImag.end(), 0.0f);
+        std::fill_n(c.stage.historyReal.begin(), ringSize * numBins, 0.0f);
+        std::fill_n(c.stage.historyImag.begin(), ringSize * numBins, 0.0f);
+    }
+}
+
+void PartitionedConvolution::process(const Impulse& impulse, const float* const* input, float* const* output,
+                                     size_t numChannels, size_t numSamples) noexcept
+{
+    jassert(impulse.partitionSize == partitionSize && impulse.numPartitions <= ringSize + 1);
+    jassert(numChannels <= channels.size());
+
+    if (impulse.numPartitions == 0) return;
+
+    // a piece never runs past the end of a short block, and a long block always ends with one
+    for (size_t done = 0; done < numSamples;)
+    {
+        auto n = juce::jmin(numSamples - done, shortPartitionSize - shortPosition);
+        auto shortBlockEnding = shortPosition + n == shortPartitionSize;
+        auto blockEnding = inputPosition + n == partitionSize;
+
+        for (size_t ch = 0; ch < numChannels; ++ch)
+        {
+            auto& c = channels[ch];
+            auto* current = c.shortInput.data() + shortPartitionSize + shortPosition;
+
+            if (input != nullptr)
+                juce::FloatVectorOperations::copy(current, input[ch] + done, (int) n);
+            else
+                juce::FloatVectorOperations::clear(current, (int) n);
+
+            juce::FloatVectorOperations::copy(c.input.data() + inputPosition, current, (int) n);
+
+            // the head, one tap at a time across the whole piece, reaching back into the last short block
+            for (size_t tap = 0; tap < shortPartitionSize; ++tap)
+                if (auto gain = impulse.head[tap]; gain != 0.0f)
+                    juce::FloatVectorOperations::addWithMultiply(output[ch] + done, current - tap, gain, (int) n);
+
+            // every partition after it meets only blocks that had finished when this one started
+            juce::FloatVectorOperations::add(output[ch] + done, c.shortStage.output.data() + shortPosition, (int) n);
+            juce::FloatVectorOperations::add(output[ch] + done, c.stage.output.data() + inputPosition, (int) n);
+
+            if (shortBlockEnding)
+            {
+                auto* block = c.shortInput.data() + shortPartitionSize;
+                finishBlock(c.shortStage, *shortFFT, block, shortPartitionSize, shortRingSize,
+                            impulse.shortReal.data(), impulse.shortImag.data(), impulse.numShortPartitions);
+                std::copy_n(block, shortPartitionSize, c.shortInput.begin());
+            }
+
+            if (blockEnding)
+                finishBlock(c.stage, *fft, c.input.data(), partitionSize, ringSize,
+                            impulse.real.data(), impulse.imag.data(), impulse.numPartitions - 1);
+        }
+
+        shortPosition = shortBlockEnding ? 0 : shortPosition + n;
+        inputPosition = blockEnding ? 0 : inputPosition + n;
+        done += n;
+    }
+}
+
+void PartitionedConvolution::finishBlock(Stage& stage, juce::dsp::FFT& stageFFT, const float* block, size_t size,
+                                         size_t ringLength, const float* impulseReal, const float* impulseImag,
+                                         size_t numImpulsePartitions) noexcept
+{
+    // with nothing for the stage to do its output stays as reset() left it, silent
+    if (ringLength == 0 || numImpulsePartitions == 0) return;
+
+    auto bins = size + 1;
+
+    // the finished block overwrites the oldest spectrum in the ring
+    stage.newest = (stage.newest + 1) % ringLength;
+    forward(stageFFT, scratch.data(), block, size,
+            stage.historyReal.data() + stage.newest * bins, stage.historyImag.data() + stage.newest * bins);
+
+    std::fill_n(outputReal.begin(), bins, 0.0f);
+    std::fill_n(outputImag.begin(), bins, 0.0f);
+
+    for (size_t partition = 0; partition < numImpulsePartitions; ++partition)
+    {
+        auto segment = (stage.newest + ringLength - partition) % ringLength;
+        multiplyAdd(stage.historyReal.data() + segment * bins, stage.historyImag.data() + segment * bins,
+                    impulseReal + partition * bins, impulseImag + partition * bins,
+                    outputReal.data(), outputImag.data(), bins);
+    }
+
+    inverse(stageFFT, scratch.data(), outputReal.data(), outputImag.data());
+
+    // the first half is the next block's, and the second half spills into the one after
+    juce::FloatVectorOperations::add(scratch.data(), stage.overlap.data(), (int) size);
+    juce::FloatVectorOperations::copy(stage.output.data(), scratch.data(), (int) size);
+    juce::FloatVectorOperations::copy(stage.overlap.data(), scratch.data() + size, (int) size);
+}
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    PartitionedConvolution.h
+    Zero-latency partitioned FFT convolution, one impulse shared by every channel.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The impulse is cut into partitions of partitionSize samples, and each one after the first is
+    transformed once, zero padded to twice that size. Every block of input is transformed the same
+    way when it is complete and kept in a ring of past spectra. The sum of each past spectrum times
+    the partition that lines up with it overlap-adds back into the time domain.
+
+    Nothing waits for a whole partition to fill, and nothing is transformed partway through a block,
+    however short the calls are. The first partition is split the same way again into short
+    partitions of shortPartitionSize, run on short blocks of input. The first short partition, the
+    head, runs as a direct-form FIR, a multiply-add per tap over each call's samples. A partition
+    only ever meets input whose block has finished, so every transform happens at a block boundary,
+    and the output never lags the input.
+
+    The spectra are kept as split real and imaginary arrays, so the complex multiply-adds are
+    plain loops that vectorise.
+*/
+class PartitionedConvolution
+{
+public:
+    /** Taps in the direct-form head, and the size of the short partitions after it. */
+    static constexpr size_t shortPartitionSize = 64;
+
+    //==============================================================================
+    /** An impulse response already cut up and transformed, ready to hand to process(). */
+    class Impulse
+    {
+    public:
+        Impulse() = default;
+
+        /** Sizes the storage for up to maxPartitions partitions, of a power of two at least
+            shortPartitionSize long. Call this before set().
+        */
+        void allocate(size_t partitionSize, size_t maxPartitions);
+
+        /** Transforms the response. Returns false, and holds nothing, if it needs more partitions than
+            were allocated. Runs an FFT per partition, so keep it off the audio thread.
+        */
+        bool set(const float* response, size_t length);
+
+        size_t getNumPartitions() const noexcept { return numPartitions; }
+        size_t getPartitionSize() const noexcept { return partitionSize; }
+
+    private:
+        friend class PartitionedConvolution;
+
+        size_t partitionSize = 0, numBins = 0, numPartitions = 0, numShortPartitions = 0;
+        std::unique_ptr<juce::dsp::FFT> fft, shortFFT;
+        std::vector<float> scratch, head;
+
+        // the spectra of every partition and short partition after the first, in order
+        std::vector<float> real, imag, shortReal, shortImag;
+
+        JUCE_DECLARE_NON_COPYABLE(Impulse)
+    };
+
+    //==============================================================================
+    PartitionedConvolution() = default;
+
+    /** Allocates the history for impulses of up to maxPartitions partitions. Nothing allocates after this. */
+    void prepare(size_t partitionSize, size_t maxPartitions, size_t numChannels);
+
+    /** Forgets all past input and sets the ring to this many partitions, which every impulse
+        used until the next reset must have.
+    */
+    void reset(size_t numPartitions) noexcept;
+
+    /** Adds the convolution of input with the impulse into output, which both have numChannels rows.
+        A null input is silence, which lets what has already gone in ring out.
+    */
+    void process(const Impulse& impulse, const float* const* input, float* const* output,
+                 size_t numChannels, size_t numSamples) noexcept;
+
+    size_t getPartitionSize() const noexcept { return partitionSize; }
+
+private:
+    /** One size of partition: the ring of spectra of past blocks, newest first, and the current
+        block's share of the output, which was worked out when the block before it finished.
+    */
+    struct Stage
+    {
+        std::vector<float> output, overlap, historyReal, historyImag;
+        size_t newest = 0;
+    };
+
+    struct Channel
+    {
+        // the short input holds the short block before the current one as well, so the head can
+        // reach back past the start of a call
+        std::vector<float> shortInput, input;
+        Stage shortStage, stage;
+    };
+
+    /** Transforms the block that has just finished into the ring and works out the next block's output. */
+    void finishBlock(Stage& stage, juce::dsp::FFT& stageFFT, const float* block, size_t size, size_t ringLength,
+                     const float* impulseReal, const float* impulseImag, size_t numImpulsePartitions) noexcept;
+
+    size_t partitionSize = 0, numBins = 0, maxPartitions = 0;
+    size_t numShortBins = 0, shortRingSize = 0, ringSize = 0;
+    size_t shortPosition = 0, inputPosition = 0;
+    std::unique_ptr<juce::dsp::FFT> fft, shortFFT;
+    std::vector<float> scratch, outputReal, outputImag;
+    std::vector<Channel> channels;
+
+    JUCE_DECLARE_NON_COPYABLE(PartitionedConvolution)
+};
@@ -10,130 +10,451 @@
 #include "PluginEditor.h"
 
 //==============================================================================
-CombFilterBankAudioProcessorEditor::CombFilterBankAudioProcessorEditor (CombFilterBankAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p) //listener class?
+// the analytic response of the whole output, drawn over the analyzer along with the curve of every
+// comb whose Display Bands button is on. Each tick recomputes only the combs whose parameters moved
+class CombFilterBankAudioProcessorEditor::BandsComponent : public juce::Component,
+                                                           private juce::Timer
 {
-    // Make sure that before the constructor has finished, you've set the
-    // editor's size to whatever you need it to be.
-    setSize (800, 600);
+public:
+    explicit BandsComponent(CombFilterBankAudioProcessor& p)
+        : audioProcessor(p),
+          response(p.getNumParameterCombs()),
+          shown(p.getNumParameterCombs(), false)
+    {
+        auto& state = p.getValueTreeState();
 
-    addAndMakeVisible(bypassButton);
+        for (size_t comb = 0; comb < p.getNumParameterCombs(); ++comb)
+            combParameters.push_back({ state.getRawParameterValue(CombFilterBankAudioProcessor::getCombParameterID(comb, "Pitch")),
+                                       state.getRawParameterValue(CombFilterBankAudioProcessor::getCombParameterID(comb, "Feedback")),
+                                       state.getRawParameterValue(CombFilterBankAudioProcessor::getCombParameterID(comb, "Level")),
+                                       state.getRawParameterValue(CombFilterBankAudioProcessor::getCombParameterID(comb, "Active")) });
 
-    addAndMakeVisible(preGainSlider);
-    preGainSlider.setRange(0.0, 1.0); // need to refactor for dB including skew
-    preGainSlider.setValue(0.0, juce::dontSendNotification);
-    //preGainSlider.setTextValueSuffix("dB");
-    addAndMakeVisible(preGainLabel);
-    preGainLabel.attachToComponent(&preGainSlider, false);
+        bypassParameter = state.getRawParameterValue("bypass");
+        preGainParameter = state.getRawParameterValue("preGain");
+        gainParameter = state.getRawParameterValue("gain");
+        wetParameter = state.getRawParameterValue("wet");
 
-    addAndMakeVisible(gainSlider);
-    gainSlider.setRange(0.0, 1.0); // need to refactor for dB including skew
-    gainSlider.setValue(0.0, juce::dontSendNotification);
-    //gainSlider.setTextValueSuffix("dB");
-    addAndMakeVisible(gainLabel);
-    gainLabel.attachToComponent(&gainSlider, false);
+        // it sits on top of the analyzer, which still gets the clicks
+        setInterceptsMouseClicks(false, false);
+        startTimerHz(60);
+    }
 
-    addAndMakeVisible(wetSlider);
-    wetSlider.setRange(0.0, 100.0);
-    wetSlider.setValue(0.0, juce::dontSendNotification);
-    wetSlider.setTextValueSuffix("%");
-    addAndMakeVisible(wetLabel);
-    wetLabel.attachToComponent(&wetSlider, true);
+    void setCombShown(size_t comb, bool shouldBeShown)
+    {
+        shown[comb] = shouldBeShown;
+        update();
+        repaint();
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        if (std::none_of(shown.begin(), shown.end(), [](bool s) { return s; })) return;
 
-    combs.resize(4);
-    for (auto& c : combs) addAndMakeVisible(c);
+        auto bounds = getLocalBounds().toFloat();
 
-    LPHPComponent LP("Lowpass");
-    LPHPComponent HP("Highpass");
-}
+        auto strokeCurve = [&](const float* decibels, juce::Colour colour, float thickness)
+        {
+            juce::Path curve;
 
-CombFilterBankAudioProcessorEditor::~CombFilterBankAudioProcessorEditor()
-{
-}
+            for (int point = 0; point < CombResponse::numPoints; ++point)
+            {
+                auto x = bounds.getX() + bounds.getWidth() * (float) point / (float) (CombResponse::numPoints - 1);
+                auto y = juce::jmap(juce::jmin(decibels[point], maxDecibels), minDecibels, maxDecibels, bounds.getBottom(), bounds.getY());
 
-//==============================================================================
-void CombFilterBankAudioProcessorEditor::paint (juce::Graphics& g)
-{
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+                if (point == 0) curve.startNewSubPath(x, y);
+                else            curve.lineTo(x, y);
+            }
 
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
-}
+            g.setColour(colour);
+            g.strokePath(curve, juce::PathStrokeType(thickness));
+        };
 
-void CombFilterBankAudioProcessorEditor::resized()
-{
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
-}
+        for (size_t comb = 0; comb < shown.size(); ++comb)
+        {
+            if (! shown[comb]) continue;
+
+            response.getCombDecibels(comb, combDecibels.data(), minDecibels);
+            strokeCurve(combDecibels.data(), juce::Colour::fromHSV((float) comb / (float) shown.size(), 0.7f, 1.0f, 0.6f), 1.0f);
+        }
+
+        strokeCurve(outputDecibels.data(), juce::Colours::white, 2.0f);
+    }
+
+private:
+    void timerCallback() override
+    {
+        if (std::none_of(shown.begin(), shown.end(), [](bool s) { return s; })) return;
+
+        if (update())
+            repaint();
+    }
+
+    // returns whether anything moved since the last call
+    bool update()
+    {
+        auto changed = false;
+
+        auto sampleRate = audioProcessor.getSampleRate();
+        if (sampleRate > 0.0 && sampleRate != response.getSampleRate())
+        {
+            response.setSampleRate(sampleRate);
+            changed = true;
+        }
+
+        for (size_t comb = 0; comb < combParameters.size(); ++comb)
+        {
+            auto& p = combParameters[comb];
+            changed |= response.setComb(comb, { p.pitch->load(), p.feedback->load(), p.level->load(),
+                                                CombBank::defaultDampingHz, p.active->load() >= 0.5f });
+        }
+
+        // bypassed, the output is the input
+        auto bypassed = bypassParameter->load() >= 0.5f;
+        auto wet = bypassed ? 0.0f : wetParameter->load() * 0.01f;
+        auto gain = bypassed ? 1.0f : juce::Decibels::decibelsToGain(preGainParameter->load() + gainParameter->load());
+
+        if (wet != lastWet || gain != lastGain)
+        {
+            lastWet = wet;
+            lastGain = gain;
+            changed = true;
+        }
+
+        if (changed)
+            response.getOutputDecibels(outputDecibels.data(), lastWet, lastGain, minDecibels);
+
+        return changed;
+    }
+
+    static constexpr float minDecibels = -48.0f, maxDecibels = 24.0f;
+
+    struct CombParameters
+    {
+        std::atomic<float>* pitch;
+        std::atomic<float>* feedback;
+        std::atomic<float>* level;
+        std::atomic<float>* active;
+    };
+
+    CombFilterBankAudioProcessor& audioProcessor;
+    std::vector<CombParameters> combParameters;
+    std::atomic<float>* bypassParameter = nullptr;
+    std::atomic<float>* preGainParameter = nullptr;
+    std::atomic<float>* gainParameter = nullptr;
+    std::atomic<float>* wetParameter = nullptr;
+
+    CombResponse response;
+    std::vector<bool> shown;
+    float lastWet = -1.0f, lastGain = -1.0f;
+    std::array<float, CombResponse::numPoints> outputDecibels {}, combDecibels {};
+};
 
 //==============================================================================
 class CombFilterBankAudioProcessorEditor::CombComponent : public juce::Component
 {
 public:
-    CombComponent()
+    CombComponent(CombFilterBankAudioProcessor& p, size_t combIndex, BandsComponent& bands)
+        : audioProcessor(p),
+          comb(combIndex),
+          activeAttachment(p.getValueTreeState(), CombFilterBankAudioProcessor::getCombParameterID(combIndex, "Active"), activeButton),
+          feedbackAttachment(p.getValueTreeState(), CombFilterBankAudioProcessor::getCombParameterID(combIndex, "Feedback"), feedbackSlider),
+          levelAttachment(p.getValueTreeState(), CombFilterBankAudioProcessor::getCombParameterID(combIndex, "Level"), levelSlider)
     {
         addAndMakeVisible(activeButton);
         addAndMakeVisible(bandsButton);
+        bandsButton.onClick = [this, &bands] { bands.setCombShown(comb, bandsButton.getToggleState()); };
+
+        // ranges and values come from the parameters through the attachments, and the bands follow
+        // the parameters, so dragging either one redraws this comb's curve
+        for (auto* slider : { &feedbackSlider, &levelSlider })
+        {
+            slider->setSliderStyle(juce::Slider::LinearHorizontal);
+            slider->setTextBoxStyle(juce::Slider::TextBoxRight, false, 40, 20);
+            addAndMakeVisible(*slider);
+        }
 
-        addAndMakeVisible(feedbackField);
         addAndMakeVisible(feedbackLabel);
-        feedbackLabel.attachToComponent(&feedbackField, true);
+        feedbackLabel.attachToComponent(&feedbackSlider, true);
 
-        addAndMakeVisible(levelField);
         addAndMakeVisible(levelLabel);
-        levelLabel.attachToComponent(&levelField, true);
+        levelLabel.attachToComponent(&levelSlider, true);
 
+        // item ids start at 1 so that 0 is left for no selection
         addAndMakeVisible(pitchBox);
-        pitchBox.setText("");
-        pitchBox.addItemList(pitches, 0); //need to verify offset
+        for (auto note = EqualTemperament::lowestNote; note <= EqualTemperament::highestNote; ++note)
+            pitchBox.addItem(EqualTemperament::getNoteName(note), note - EqualTemperament::lowestNote + 1);
+
+        pitchBox.onChange = [this] { pitchChanged(); };
         addAndMakeVisible(pitchLabel);
         pitchLabel.attachToComponent(&pitchBox, true);
+
+        // clearing the lines isn't a parameter, so it goes to the audio thread as a command
+        addAndMakeVisible(resetButton);
+        resetButton.onClick = [this]
+        {
+            audioProcessor.pushCommand({ CombFilterBankAudioProcessor::BankCommand::Type::reset, comb, 0.0f });
+        };
     };
 
-    void paint(juce::Graphics&) {};
-    void resized() {};
+    void paint(juce::Graphics&) override {};
+
+    // one row, left to right. The labels sit to the left of the controls they are attached to, so
+    // each of those gets a gap in front of it
+    void resized() override
+    {
+        auto row = getLocalBounds().reduced(2);
+
+        activeButton.setBounds(row.removeFromLeft(30));
+        row.removeFromLeft(45);
+        pitchBox.setBounds(row.removeFromLeft(90));
+        row.removeFromLeft(70);
+
+        resetButton.setBounds(row.removeFromRight(60));
+        bandsButton.setBounds(row.removeFromRight(120));
+
+        // the sliders split what is left
+        auto sliderWidth = juce::jmax(0, row.getWidth() - 45) / 2;
+        feedbackSlider.setBounds(row.removeFromLeft(sliderWidth));
+        row.removeFromLeft(45);
+        levelSlider.setBounds(row.removeFromLeft(sliderWidth));
+    }
+
+    // a comb set to a note moves its parameter to wherever the new tuning puts the note
+    void tuningChanged() { pitchChanged(); }
 
 private:
+    // the pitch parameter is continuous, the box offers the notes from C0 to C9 under the current
+    // tuning. The comb follows the note, and the parameter keeps its pitch for the host and the session
+    void pitchChanged()
+    {
+        auto id = pitchBox.getSelectedId();
+        if (id == 0) return;
+
+        auto note = EqualTemperament::lowestNote + id - 1;
+        auto frequencyHz = audioProcessor.getNotePitch(note);
+        if (frequencyHz <= 0.0f) return;
+
+        audioProcessor.pushCommand({ CombFilterBankAudioProcessor::BankCommand::Type::setNote, comb, (float) note });
+
+        auto* pitch = audioProcessor.getValueTreeState().getParameter(CombFilterBankAudioProcessor::getCombParameterID(comb, "Pitch"));
+
+        pitch->beginChangeGesture();
+        pitch->setValueNotifyingHost(pitch->convertTo0to1(frequencyHz));
+        pitch->endChangeGesture();
+    }
+
+    CombFilterBankAudioProcessor& audioProcessor;
+    size_t comb;
+
     juce::ToggleButton activeButton { "" },
                        bandsButton {"Display Bands"};
+    juce::TextButton resetButton {"Reset"};
     juce::Label pitchLabel {"PitchLabel", "Pitch"}, 
                 feedbackLabel {"FeedbackLabel", "Feedback"}, 
-                feedbackField {"FeedbackField", "0.0"}, 
-                levelLabel {"LevelLabel", "Level"}, 
-                levelField {"LevelField", "0.0"};
+                levelLabel {"LevelLabel", "Level"};
+    juce::Slider feedbackSlider, levelSlider;
     juce::ComboBox pitchBox {"PitchBox"};
 
-    juce::StringArray pitches
-    {
-        "", //need to leave index 0 untouched for no selection
-        "C2", "C#2", "D2", "D#2", "E2", "F2", "F#2", "G2", "G#2", "A2", "A#2", "B2",
-        "C3", "C#3", "D3", "D#3", "E3", "F3", "F#3", "G3", "G#3", "A3", "A#3", "B3",
-        "C4", "C#4", "D4", "D#4", "E4", "F4", "F#4", "G4", "G#4", "A4", "A#4", "B4",
-        "C5", "C#5", "D5", "D#5", "E5", "F5", "F#5", "G5", "G#5", "A5", "A#5", "B5",
-    };
+    juce::AudioProcessorValueTreeState::ButtonAttachment activeAttachment;
+    juce::AudioProcessorValueTreeState::SliderAttachment feedbackAttachment, levelAttachment;
 };
 
-class CombFilterBankAudioProcessorEditor::LPHPComponent : public juce::Component
+//==============================================================================
+// histogram of block load, with the deadline marked. Clicking it starts the counts again
+class CombFilterBankAudioProcessorEditor::LoadMeterComponent : public juce::Component,
+                                                               private juce::Timer
 {
 public:
-    LPHPComponent(juce::String filterName)
+    explicit LoadMeterComponent(LoadMeter& m) : meter(m)
     {
-        addAndMakeVisible(activeButton);
-        addAndMakeVisible(freqField);
-        addAndMakeVisible(freqLabel);
-        freqLabel.setText(filterName, juce::dontSendNotification);
-    };
+        startTimerHz(15);
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        auto bounds = getLocalBounds().toFloat();
+        g.setColour(juce::Colours::black.withAlpha(0.3f));
+        g.fillRect(bounds);
+
+        auto textArea = bounds.removeFromTop(18.0f);
+        auto maxCount = (float) juce::jmax((juce::uint32) 1, *std::max_element(histogram.begin(), histogram.end()));
+        auto barWidth = bounds.getWidth() / (float) LoadMeter::numBins;
+
+        for (int i = 0; i < LoadMeter::numBins; ++i)
+        {
+            auto height = bounds.getHeight() * (float) histogram[(size_t) i] / maxCount;
+            auto overDeadline = (float) i * LoadMeter::binWidth >= 1.0f;
+
+            g.setColour(overDeadline ? juce::Colours::red : juce::Colours::limegreen);
+            g.fillRect(bounds.getX() + (float) i * barWidth, bounds.getBottom() - height, barWidth - 1.0f, height);
+        }
+
+        auto deadlineX = bounds.getX() + bounds.getWidth() / ((float) LoadMeter::numBins * LoadMeter::binWidth);
+        g.setColour(juce::Colours::white);
+        g.drawVerticalLine(juce::roundToInt(deadlineX), bounds.getY(), bounds.getBottom());
+
+        auto percent = [](float load) { return juce::String(juce::roundToInt(load * 100.0f)) + "%"; };
+
+        g.setFont(13.0f);
+        g.drawText("DSP load " + percent(latest) + "   peak " + percent(peak)
+                       + "   p99 " + percent(LoadMeter::getPercentile(histogram, 0.99f))
+                       + "   overruns " + juce::String((int) overruns),
+                   textArea, juce::Justification::centredLeft);
+    }
 
-    void paint(juce::Graphics&) {};
-    void resized() {};
+    void mouseDown(const juce::MouseEvent&) override { meter.reset(); }
 
 private:
-    juce::ToggleButton activeButton { "" };
-    juce::Label freqLabel{ "FreqLabel", "Frequency" },
-                freqField {"FreqField", "0"};
+    void timerCallback() override
+    {
+        histogram = meter.getHistogram();
+        latest = meter.getLatestLoad();
+        peak = meter.getPeakLoad();
+        overruns = meter.getNumOverruns();
+        repaint();
+    }
+
+    LoadMeter& meter;
+    std::array<juce::uint32, LoadMeter::numBins> histogram {};
+    float latest = 0.0f, peak = 0.0f;
+    juce::uint32 overruns = 0;
 };
 
-//need to figure out how I'm going to pass the graphics to this component, as this needs DSP info
-//class CombFilterBankAudioProcessorEditor::Analyzer : juce::Component
\ No newline at end of file
+//==============================================================================
+CombFilterBankAudioProcessorEditor::CombFilterBankAudioProcessorEditor (CombFilterBankAudioProcessor& p)
+    : AudioProcessorEditor (&p), audioProcessor (p),
+      bypassAttachment (p.getValueTreeState(), "bypass", bypassButton),
+      preGainAttachment (p.getValueTreeState(), "preGain", preGainSlider),
+      gainAttachment (p.getValueTreeState(), "gain", gainSlider),
+      wetAttachment (p.getValueTreeState(), "wet", wetSlider),
+      midiNotesAttachment (p.getValueTreeState(), "midiNotes", midiNotesButton),
+      loadMeter (std::make_unique<LoadMeterComponent>(p.getLoadMeter())),
+      analyzer (p),
+      bands (std::make_unique<BandsComponent>(p))
+{
+    // Make sure that before the constructor has finished, you've set the
+    // editor's size to whatever you need it to be.
+    setSize (800, 600);
+
+    addAndMakeVisible(bypassButton);
+
+    // ranges and values come from the parameters through the attachments
+    addAndMakeVisible(preGainSlider);
+    preGainSlider.setTextValueSuffix(" dB");
+    addAndMakeVisible(preGainLabel);
+    preGainLabel.attachToComponent(&preGainSlider, false);
+
+    addAndMakeVisible(gainSlider);
+    gainSlider.setTextValueSuffix(" dB");
+    addAndMakeVisible(gainLabel);
+    gainLabel.attachToComponent(&gainSlider, false);
+
+    addAndMakeVisible(wetSlider);
+    wetSlider.setTextValueSuffix("%");
+    addAndMakeVisible(wetLabel);
+    wetLabel.attachToComponent(&wetSlider, true);
+
+    // one strip per comb that has parameters
+    for (size_t comb = 0; comb < p.getNumParameterCombs(); ++comb)
+        addAndMakeVisible(combs.add(new CombComponent(p, comb, *bands)));
+
+    // a tuning isn't a parameter, so it goes to the processor whole and the combs set to notes follow it
+    addAndMakeVisible(loadTuningButton);
+    loadTuningButton.onClick = [this] { chooseTuning(); };
+    addAndMakeVisible(equalTemperamentButton);
+    equalTemperamentButton.onClick = [this] { applyTuning(Tuning()); };
+    addAndMakeVisible(tuningLabel);
+    tuningLabel.setText(p.getTuning().getName(), juce::dontSendNotification);
+
+    // with MIDI Notes on, the active combs play the notes that come in, under the same tuning
+    addAndMakeVisible(midiNotesButton);
+    addAndMakeVisible(voiceAllocationBox);
+    voiceAllocationBox.addItemList(p.getValueTreeState().getParameter("voiceAllocation")->getAllValueStrings(), 1);
+    voiceAllocationAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(p.getValueTreeState(), "voiceAllocation", voiceAllocationBox);
+
+    addAndMakeVisible(*loadMeter);
+    addAndMakeVisible(analyzer);
+    addAndMakeVisible(*bands);
+}
+
+CombFilterBankAudioProcessorEditor::~CombFilterBankAudioProcessorEditor()
+{
+}
+
+//==============================================================================
+void CombFilterBankAudioProcessorEditor::chooseTuning()
+{
+    // a scale on its own, or a scale and a keyboard mapping picked together
+    tuningChooser = std::make_unique<juce::FileChooser>("Load a Scala tuning", juce::File(), "*.scl;*.kbm");
+    auto flags = juce::FileChooser::openMode | juce::FileChooser::canSelectFiles | juce::FileChooser::canSelectMultipleItems;
+
+    tuningChooser->launchAsync(flags, [this] (const juce::FileChooser& chooser)
+    {
+        juce::File scaleFile, mappingFile;
+        for (auto& file : chooser.getResults())
+            (file.hasFileExtension("kbm") ? mappingFile : scaleFile) = file;
+
+        if (! scaleFile.existsAsFile()) return;
+
+        Tuning tuning;
+        auto result = tuning.loadScala(scaleFile.loadFileAsString(), mappingFile.existsAsFile() ? mappingFile.loadFileAsString() : juce::String());
+
+        if (result.failed())
+        {
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Couldn't load " + scaleFile.getFileName(), result.getErrorMessage());
+            return;
+        }
+
+        applyTuning(tuning);
+    });
+}
+
+void CombFilterBankAudioProcessorEditor::applyTuning (const Tuning& tuning)
+{
+    audioProcessor.setTuning(tuning);
+    tuningLabel.setText(tuning.getName(), juce::dontSendNotification);
+
+    for (auto* comb : combs)
+        comb->tuningChanged();
+}
+
+//==============================================================================
+void CombFilterBankAudioProcessorEditor::paint (juce::Graphics& g)
+{
+    // (Our component is opaque, so we must completely fill the background with a solid colour)
+    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
+}
+
+void CombFilterBankAudioProcessorEditor::resized()
+{
+    // This is generally where you'll want to lay out the positions of any
+    // subcomponents in your editor..
+    auto bounds = getLocalBounds();
+
+    auto tuningRow = bounds.removeFromTop(32).reduced(4);
+    loadTuningButton.setBounds(tuningRow.removeFromLeft(120));
+    equalTemperamentButton.setBounds(tuningRow.removeFromLeft(80));
+    voiceAllocationBox.setBounds(tuningRow.removeFromRight(120));
+    midiNotesButton.setBounds(tuningRow.removeFromRight(110));
+    tuningLabel.setBounds(tuningRow);
+
+    // the gain labels sit above their sliders and the wet label to the left of its own
+    auto controlsRow = bounds.removeFromTop(64).reduced(8);
+    controlsRow.removeFromTop(20);
+    bypassButton.setBounds(controlsRow.removeFromLeft(90));
+    preGainSlider.setBounds(controlsRow.removeFromLeft(220));
+    gainSlider.setBounds(controlsRow.removeFromLeft(220));
+    controlsRow.removeFromLeft(80);
+    wetSlider.setBounds(controlsRow);
+
+    loadMeter->setBounds(bounds.removeFromBottom(80).reduced(8));
+    analyzer.setBounds(bounds.removeFromBottom(200).reduced(8));
+    bands->setBounds(analyzer.getBounds());
+
+    // the comb strips share what is left, one row each
+    auto combArea = bounds.reduced(8, 0);
+    auto rowHeight = combs.isEmpty() ? 0 : juce::jmin(32, combArea.getHeight() / combs.size());
+
+    for (auto* comb : combs)
+        comb->setBounds(combArea.removeFromTop(rowHeight));
+}
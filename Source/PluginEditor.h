@@ -10,6 +10,8 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "SpectrumAnalyzer.h"
+#include "CombResponse.h"
 
 //==============================================================================
 /**
@@ -37,10 +39,34 @@ private:
                 gainLabel {"GainLabel", "Gain"},
                 wetLabel {"WetLabel", "Wet Ratio"};
 
+    // declared after the controls they drive, so they are destroyed first
+    juce::AudioProcessorValueTreeState::ButtonAttachment bypassAttachment;
+    juce::AudioProcessorValueTreeState::SliderAttachment preGainAttachment, gainAttachment, wetAttachment;
+
     class CombComponent;
-    std::vector<CombComponent> combs;
+    juce::OwnedArray<CombComponent> combs;
+
+    /** Asks for a .scl, and optionally a .kbm to go with it, and loads them as the tuning. */
+    void chooseTuning();
+    void applyTuning (const Tuning& tuning);
+
+    juce::TextButton loadTuningButton { "Load Tuning..." }, equalTemperamentButton { "12-TET" };
+    juce::Label tuningLabel { "TuningLabel" };
+    std::unique_ptr<juce::FileChooser> tuningChooser;
+
+    // the box's attachment is made once its items are in, or it would select nothing
+    juce::ToggleButton midiNotesButton { "MIDI Notes" };
+    juce::ComboBox voiceAllocationBox { "VoiceAllocationBox" };
+    juce::AudioProcessorValueTreeState::ButtonAttachment midiNotesAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> voiceAllocationAttachment;
+
+    class LoadMeterComponent;
+    std::unique_ptr<LoadMeterComponent> loadMeter;
+
+    SpectrumAnalyzer analyzer;
 
-    class LPHPComponent;
+    class BandsComponent;
+    std::unique_ptr<BandsComponent> bands;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CombFilterBankAudioProcessorEditor)
 };
\ No newline at end of file
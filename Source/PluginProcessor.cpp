@@ -10,170 +10,517 @@
 #include "PluginEditor.h"
 
 //==============================================================================
-class CombFilterBankAudioProcessor::DelayLine
+//why is this happy to come after private classes when editor isn't??
+CombFilterBankAudioProcessor::CombFilterBankAudioProcessor (size_t numCombs)
+    : AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo())
+                                      .withOutput("Output", juce::AudioChannelSet::stereo())),
+      requestedNumCombs(numCombs),
+      bank(numCombs),
+      parameters(*this, nullptr, "Parameters", createParameterLayout(numCombs))
 {
-public:
-    //DelayLine() {} //do I need to use explicit constructor?
+    bypassParameter = parameters.getRawParameterValue("bypass");
+    preGainParameter = parameters.getRawParameterValue("preGain");
+    gainParameter = parameters.getRawParameterValue("gain");
+    wetParameter = parameters.getRawParameterValue("wet");
+    midiNotesParameter = parameters.getRawParameterValue("midiNotes");
+    voiceAllocationParameter = parameters.getRawParameterValue("voiceAllocation");
+
+    combParameters.resize(numCombs);
+    for (size_t comb = 0; comb < numCombs; ++comb)
+    {
+        auto& p = combParameters[comb];
+        p.pitch = parameters.getRawParameterValue(getCombParameterID(comb, "Pitch"));
+        p.feedback = parameters.getRawParameterValue(getCombParameterID(comb, "Feedback"));
+        p.level = parameters.getRawParameterValue(getCombParameterID(comb, "Level"));
+        p.active = parameters.getRawParameterValue(getCombParameterID(comb, "Active"));
+    }
+}
 
-    void clear() noexcept { std::fill(rawData.begin(), rawData.end(), 0); }
+CombFilterBankAudioProcessor::~CombFilterBankAudioProcessor()
+{
+}
+
+//==============================================================================
+juce::AudioProcessorValueTreeState::ParameterLayout CombFilterBankAudioProcessor::createParameterLayout (size_t numCombs)
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    juce::NormalisableRange<float> gainRange (-48.0f, 12.0f, 0.1f);
+    juce::NormalisableRange<float> pitchRange (CombBank::minPitchHz, maxPitchHz);
+    pitchRange.setSkewForCentre(440.0f);
 
-    size_t size() const noexcept { return rawData.size(); }
+    layout.add(std::make_unique<juce::AudioParameterBool>("bypass", "Bypass", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("preGain", "Pre-gain", gainRange, 0.0f, "dB"));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("gain", "Gain", gainRange, 0.0f, "dB"));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("wet", "Wet Ratio", juce::NormalisableRange<float> (0.0f, 100.0f, 0.1f), 50.0f, "%"));
+    layout.add(std::make_unique<juce::AudioParameterBool>("midiNotes", "MIDI Notes", false));
+    layout.add(std::make_unique<juce::AudioParameterChoice>("voiceAllocation", "Voice Allocation", juce::StringArray { "Round Robin", "Oldest" }, 0));
 
-    void resize(size_t newValue) //do I want to resize buffer? Will cause audio glitch
+    for (size_t comb = 0; comb < numCombs; ++comb)
     {
-        rawData.resize(newValue);
-        leastRecentIndex = 0;
+        auto name = "Comb " + juce::String((int) comb + 1) + " ";
+
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getCombParameterID(comb, "Pitch"), name + "Pitch", pitchRange, CombBank::defaultPitchHz, "Hz"));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getCombParameterID(comb, "Feedback"), name + "Feedback", 0.0f, 1.0f, 0.5f));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getCombParameterID(comb, "Level"), name + "Level", 0.0f, 1.0f, 0.25f));
+        layout.add(std::make_unique<juce::AudioParameterBool>(getCombParameterID(comb, "Active"), name + "Active", false));
+    }
+
+    return layout;
 }
 
-    float back() const noexcept { return rawData[leastRecentIndex]; }
+juce::String CombFilterBankAudioProcessor::getCombParameterID (size_t comb, const juce::String& name)
+{
+    return "comb" + juce::String((int) comb + 1) + name;
+}
+
+juce::AudioProcessorParameter* CombFilterBankAudioProcessor::getBypassParameter() const
+{
+    return parameters.getParameter("bypass");
+}
+
+//==============================================================================
+const juce::String CombFilterBankAudioProcessor::getName() const { return JucePlugin_Name; }
+bool CombFilterBankAudioProcessor::acceptsMidi() const { return true; }
+bool CombFilterBankAudioProcessor::producesMidi() const { return false; }
+bool CombFilterBankAudioProcessor::isMidiEffect() const { return false; }
+
+// worked out by the audio thread from the delays the combs actually play, which in MIDI mode, on a
+// note or under a tuning aren't the pitch parameter's
+double CombFilterBankAudioProcessor::getTailLengthSeconds() const
+{
+    return tailLengthSeconds.load(std::memory_order_relaxed);
+}
+
+int CombFilterBankAudioProcessor::getNumPrograms() { return 1; }
+int CombFilterBankAudioProcessor::getCurrentProgram() { return 0; }
+void CombFilterBankAudioProcessor::setCurrentProgram (int index) {}
+const juce::String CombFilterBankAudioProcessor::getProgramName(int index) { return {}; }
+void CombFilterBankAudioProcessor::changeProgramName (int index, const juce::String& newName) {}
+
+//==============================================================================
+void CombFilterBankAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
+{
+    if (requestedNumCombs != bank.getNumCombs())
+        bank.setNumCombs(requestedNumCombs);
+
+    // the bank sizes its per-partition scratch from the pool, so the pool goes first
+    if (requestedNumWorkers != workers.getNumWorkers())
+        workers.start(requestedNumWorkers);
+
+    bank.setWorkerPool(requestedNumWorkers > 0 ? &workers : nullptr);
+
+    // one row per channel for the summed wet signal
+    wetBuffer.setSize(juce::jmin(getTotalNumOutputChannels(), (int) CombBank::maxNumChannels), samplesPerBlock);
+
+    // decimated, the bank and the convolution only ever see the lower rate and the blocks it makes
+    if (decimationRequested)
+        decimator.prepare(sampleRate, (size_t) samplesPerBlock, (size_t) wetBuffer.getNumChannels());
+    else
+        decimator.release();
+
+    auto bankBlockSize = decimator.isActive() ? (int) decimator.getMaxInternalBlockSize() : samplesPerBlock;
+    bankSampleRate = decimator.isActive() ? decimator.getInternalRate() : sampleRate;
+    setLatencySamples(decimator.getLatencySamples());
+
+    juce::dsp::ProcessSpec spec { bankSampleRate, (juce::uint32) bankBlockSize, (juce::uint32) getTotalNumOutputChannels() };
+    bank.prepare(spec);
+
+    rampBuffer.assign((size_t) samplesPerBlock, 0.0f);
+    tails.prepare(bank.getNumCombs());
+    loadMeter.prepare(sampleRate);
+    analyzerMix.assign((size_t) samplesPerBlock, 0.0f);
+
+    // start every value where the parameters are now rather than ramping in from the defaults
+    preGain.reset(sampleRate, smoothingSeconds);
+    gain.reset(sampleRate, smoothingSeconds);
+    wetLevel.reset(sampleRate, smoothingSeconds);
+    preGain.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(preGainParameter->load()));
+    gain.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(gainParameter->load()));
+    wetLevel.setCurrentAndTargetValue(wetParameter->load() * 0.01f);
+    preGainRamp.reset(preGain.getCurrentValue());
+    gainRamp.reset(gain.getCurrentValue());
+    wetRamp.reset(wetLevel.getCurrentValue());
+
+    // the grid starts again from the first sample, with a tick there
+    samplesUntilControl = 0;
+    intervalPeak = 0.0f;
+    intervalSamples = 0;
 
-    float get(size_t delayInSamples) const noexcept
     {
-        jassert(delayInSamples >= 0 && delayInSamples < size());
-        return rawData[(leastRecentIndex + 1 + delayInSamples) % size()];
+        // any map waiting for the audio thread was built for the old rate, so it is dropped
+        const juce::ScopedLock lock (tuningLock);
+        delayMaps[(size_t) frontMap].build(tuning, bankSampleRate, CombBank::minPitchHz, maxPitchHz);
+        middleMap.fetch_and(~freshMap);
     }
 
-    void set(size_t delayInSamples, float newValue) noexcept
+    // combs keep the notes they were playing, worked out again for the new rate
+    combNotes.resize(bank.getNumCombs(), noNote);
+    auto& map = delayMaps[(size_t) frontMap];
+
+    // notes held across a restart are forgotten, and their combs start silent
+    voices.prepare(juce::jmin(combParameters.size(), bank.getNumCombs()));
+    lastMidiNotes = midiNotesParameter->load() >= 0.5f;
+
+    for (size_t comb = 0; comb < juce::jmin(combParameters.size(), bank.getNumCombs()); ++comb)
     {
-        jassert(delayInSamples >= 0 && delayInSamples < size());
-        rawData[(leastRecentIndex + 1 + delayInSamples)] = newValue;
+        auto& p = combParameters[comb];
+        p.lastPitch = p.pitch->load();
+        p.lastFeedback = p.feedback->load();
+        p.lastLevel = p.level->load();
+        p.lastActive = p.active->load() >= 0.5f;
+
+        if (map.isMapped(combNotes[comb]))
+            bank.setDelay(comb, map.getDelay(combNotes[comb]));
+        else
+            bank.setPitch(comb, p.lastPitch);
+
+        bank.setFeedback(comb, p.lastFeedback);
+        bank.setLevel(comb, lastMidiNotes ? 0.0f : p.lastLevel);
+        bank.setActive(comb, p.lastActive);
     }
 
-    void push(float valueToAdd) noexcept
+    // the convolution's scratch is only worth holding while it is switched on
+    if (convolutionRequested)
+    {
+        // the block is cut at every control tick, so the convolution is never handed more than one
+        // interval at a time, and less of it decimated
+        auto callSize = juce::jmin(controlInterval, (size_t) samplesPerBlock) / decimator.getFactor();
+        convolver.prepare(bankSampleRate, juce::jmax(callSize, (size_t) 1), (size_t) wetBuffer.getNumChannels(), bank.getNumCombs());
+        silentInput.setSize(wetBuffer.getNumChannels(), bankBlockSize);
+        silentInput.clear();
+    }
+    else
     {
-        rawData[leastRecentIndex] = valueToAdd;
-        leastRecentIndex = leastRecentIndex == 0 ? size() - 1 : leastRecentIndex - 1;
+        convolver.release();
+        silentInput.setSize(0, 0);
     }
 
-private:
-    std::vector<float> rawData;
-    size_t leastRecentIndex = 0;
-};
+    bankChanged();
+    updateTailLength();
+}
 
-//==============================================================================
-class CombFilterBankAudioProcessor::Comb
+void CombFilterBankAudioProcessor::runControl() noexcept
 {
-public:
-    Comb() //need to pass freq
+    // what the bank ran since the last tick, as one block. Decimated, the bank ran a factor fewer
+    // samples than went past, give or take the few waiting for the next block
+    if (intervalSamples >= decimator.getFactor())
     {
-        active = false;
-        //need to think about whether I need to initialize these values or pass them into constructor
-        setFeedback(0.5f);
-        setLevel(0.25f);
-        //need to replace below value with frequency-determined size in samples
-        delayTimeSamples = (size_t)1024;
-        for (auto& dline : delayLines) dline.resize(delayTimeSamples);
+        tails.addBlock(bank, intervalPeak, intervalSamples / decimator.getFactor());
+        intervalPeak = 0.0f;
+        intervalSamples = 0;
     }
 
-    void prepare(const juce::dsp::ProcessSpec& spec)
+    // a new tuning lands first, so the notes below are looked up in it
+    if ((middleMap.load(std::memory_order_relaxed) & freshMap) != 0)
     {
-        jassert(spec.numChannels <= maxNumChannels);
-        double sampleRate = spec.sampleRate;
-        //I'm leaving out some code about resizing buffer from example
+        frontMap = middleMap.exchange(frontMap, std::memory_order_acq_rel) & ~freshMap;
+        retuneNotes();
+    }
 
-        //1: should play around with different types of filters for decay
-        //2: need to calculate cutoff frequency based on pitch of comb
-        coefs = juce::dsp::IIR::Coefficients<double>::makeFirstOrderLowPass(sampleRate, 1e3);
+    // structural edits from the editor land next, then anything the host moved
+    commands.drain([this] (const BankCommand& command) { applyCommand(command); });
+    updateParameters();
+
+    if (tailGeneration != bankGeneration)
+        updateTailLength();
+
+    preGainRamp.step(preGain);
+    gainRamp.step(gain);
+    wetRamp.step(wetLevel);
+
+    // nothing between here and the next tick activates a comb, so this holds for the whole interval
+    tailsRinging = tails.isRinging(bank);
+    samplesUntilControl = controlInterval;
+}
+
+// how long the slowest active comb takes to fall from full scale to silence, one delay to come out
+// and then delay * log(threshold) / log(feedback) to die away. At full feedback it never does
+void CombFilterBankAudioProcessor::updateTailLength() noexcept
+{
+    tailGeneration = bankGeneration;
+    auto tailSeconds = 0.0;
 
-        for (auto& f : filters)
+    for (size_t comb = 0; comb < bank.getNumCombs(); ++comb)
+    {
+        if (! bank.isActive(comb)) continue;
+
+        auto feedback = (double) bank.getMaxFeedback(comb);
+        if (feedback >= 1.0)
         {
-            f.prepare(spec);
-            f.coefficients = coefs;
+            tailSeconds = std::numeric_limits<double>::infinity();
+            break;
         }
+
+        auto delaySeconds = (double) bank.getMaxDelay(comb) / bankSampleRate;
+        auto periods = feedback > 0.0 ? std::log((double) TailTracker::silenceThreshold) / std::log(feedback) : 0.0;
+        tailSeconds = juce::jmax(tailSeconds, delaySeconds * (1.0 + periods));
     }
 
-    void reset() noexcept
+    tailLengthSeconds.store(tailSeconds, std::memory_order_relaxed);
+}
+
+void CombFilterBankAudioProcessor::updateParameters() noexcept
+{
+    preGain.setTargetValue(juce::Decibels::decibelsToGain(preGainParameter->load()));
+    gain.setTargetValue(juce::Decibels::decibelsToGain(gainParameter->load()));
+    wetLevel.setTargetValue(wetParameter->load() * 0.01f);
+
+    auto rampSamples = (size_t) (smoothingSeconds * bankSampleRate);
+
+    voices.setMode(voiceAllocationParameter->load() >= 0.5f ? VoiceAllocator::Mode::oldest : VoiceAllocator::Mode::roundRobin);
+
+    // switching MIDI on silences every comb until a note picks it, and switching it off gives each
+    // its own level back
+    auto midiNotes = midiNotesParameter->load() >= 0.5f;
+    if (midiNotes != lastMidiNotes)
     {
-        for (auto& f : filters) f.reset();
-        for (auto& dline : delayLines) dline.clear();
+        lastMidiNotes = midiNotes;
+        voices.reset();
+
+        for (size_t comb = 0; comb < juce::jmin(combParameters.size(), bank.getNumCombs()); ++comb)
+            bank.setLevel(comb, midiNotes ? 0.0f : combParameters[comb].lastLevel, rampSamples);
+
+        bankChanged();
+    }
+
+    for (size_t comb = 0; comb < juce::jmin(combParameters.size(), bank.getNumCombs()); ++comb)
+    {
+        auto& p = combParameters[comb];
+
+        // only an edge counts, so a command that switched the comb isn't undone by a parameter
+        // that hasn't moved
+        auto shouldBeActive = p.active->load() >= 0.5f;
+        if (shouldBeActive != p.lastActive)
+        {
+            p.lastActive = shouldBeActive;
+            applyCommand({ BankCommand::Type::setActive, comb, shouldBeActive ? 1.0f : 0.0f });
+        }
+
+        // the editor moves the parameter to every note it sets, which mustn't let go of the note. The
+        // value has been through the normalised range, so it only comes back to within a rounding error
+        auto newPitch = p.pitch->load();
+        if (newPitch != p.lastPitch)
+        {
+            p.lastPitch = newPitch;
+            auto note = combNotes[comb];
+
+            if (note == noNote || std::abs(newPitch - delayMaps[(size_t) frontMap].getPitch(note)) > newPitch * 1.0e-5f)
+                applyCommand({ BankCommand::Type::setPitch, comb, newPitch });
+        }
+
+        // a new target restarts the ramp from wherever the comb has got to
+        auto newFeedback = p.feedback->load();
+        if (newFeedback != p.lastFeedback)
+        {
+            p.lastFeedback = newFeedback;
+            bank.setFeedback(comb, newFeedback, rampSamples);
+            bankChanged();
+        }
+
+        // with MIDI on the level only scales the velocity of the next note
+        auto newLevel = p.level->load();
+        if (newLevel != p.lastLevel)
+        {
+            p.lastLevel = newLevel;
+
+            if (! midiNotes)
+            {
+                bank.setLevel(comb, newLevel, rampSamples);
+                bankChanged();
+            }
+        }
     }
+}
 
-    size_t getNumChannels() const noexcept { return delayLines.size(); }
+void CombFilterBankAudioProcessor::applyCommand (const BankCommand& command) noexcept
+{
+    if (command.comb >= bank.getNumCombs()) return;
 
-    bool isActive() noexcept { return active; }
-    void toggleActive() noexcept { active = !active; }
+    bankChanged();
+    auto fadeSamples = (size_t) (crossfadeSeconds * bankSampleRate);
+    auto glideSamples = (size_t) (smoothingSeconds * bankSampleRate);
 
-    void setFeedback(float newValue) noexcept
+    switch (command.type)
     {
-        jassert(newValue >= 0.0f && newValue <= 1.0f);
-        feedback = newValue;
+        case BankCommand::Type::setActive:    bank.setActive(command.comb, command.value >= 0.5f, fadeSamples); break;
+        case BankCommand::Type::toggleActive: bank.toggleActive(command.comb, fadeSamples); break;
+
+        case BankCommand::Type::reset:
+            // the line will be empty once the fade is done, and until then the fade counts as ringing
+            bank.resetComb(command.comb, fadeSamples);
+            tails.resetComb(command.comb);
+            break;
+
+        case BankCommand::Type::setPitch:
+            // the tap slides to the new pitch like any other smoothed value, rather than fading between two
+            combNotes[command.comb] = noNote;
+            bank.glidePitch(command.comb, juce::jlimit(CombBank::minPitchHz, maxPitchHz, command.value), glideSamples);
+            break;
+
+        case BankCommand::Type::setNote:
+        {
+            // the map already holds the delay for this rate, so a note is a lookup
+            auto note = (int) command.value;
+            auto& map = delayMaps[(size_t) frontMap];
+            if (! map.isMapped(note)) break;
+
+            combNotes[command.comb] = note;
+            bank.glideDelay(command.comb, map.getDelay(note), glideSamples);
+            break;
+        }
     }
+}
 
-    void setLevel(float newValue) noexcept
+juce::MidiBufferIterator CombFilterBankAudioProcessor::handleMidiUntil (juce::MidiBufferIterator event, juce::MidiBufferIterator end, int sample) noexcept
+{
+    for (; event != end && (*event).samplePosition <= sample; ++event)
     {
-        jassert(newValue >= 0.0f && newValue <= 1.0f);
-        level = newValue;
+        // the messages that matter are three bytes at most, and copying anything longer would allocate
+        auto metadata = *event;
+        if (metadata.numBytes <= 3)
+            handleMidiEvent(metadata.getMessage());
     }
 
-    float processSample(size_t ch, float currentSamp) noexcept
+    return event;
+}
+
+void CombFilterBankAudioProcessor::handleMidiEvent (const juce::MidiMessage& message) noexcept
+{
+    // notes are only read with MIDI Notes on
+    if (! lastMidiNotes) return;
+
+    auto fadeSamples = (size_t) (crossfadeSeconds * bankSampleRate);
+    auto releaseSamples = (size_t) (smoothingSeconds * bankSampleRate);
+
+    // a released comb fades out, but its line rings on until a new note takes it
+    auto release = [&] (size_t comb)
+    {
+        bank.setLevel(comb, 0.0f, releaseSamples);
+        bankChanged();
+    };
+
+    if (message.isNoteOn())
+    {
+        auto note = message.getNoteNumber();
+        auto& map = delayMaps[(size_t) frontMap];
+        if (! map.isMapped(note)) return;
+
+        // only combs that are switched on are voices, so the Active buttons set the polyphony
+        auto comb = voices.noteOn(note, [this] (size_t c) { return bank.isActive(c) && ! bank.isFadingOut(c); });
+        if (comb < 0) return;
+
+        // a stolen comb crossfades to its new tap while the level moves to the velocity
+        combNotes[(size_t) comb] = note;
+        bank.setDelay((size_t) comb, map.getDelay(note), fadeSamples);
+        bank.setLevel((size_t) comb, message.getFloatVelocity() * combParameters[(size_t) comb].lastLevel, fadeSamples);
+        bankChanged();
+    }
+    else if (message.isNoteOff())
+    {
+        if (auto comb = voices.noteOff(message.getNoteNumber()); comb >= 0)
+            release((size_t) comb);
+    }
+    else if (message.isSustainPedalOn() || message.isSustainPedalOff())
     {
-        auto& dline = delayLines[ch];
-        auto& filter = filters[ch];
-
-        auto delayedSample = filter.processSample(dline.get(delayTimeSamples));
-        //I don't know enough math to understand hyperbolic tangent, but this is supposed to balance sum
-        //if my comb doesn't work correctly, I suspect this may need closer examination
-        auto dlineInputSample = std::tanh(currentSamp + (feedback * delayedSample));
-        dline.push(dlineInputSample);
-        //below may need balancing or rethinking if filter doesn't sound right
-        //return (currentSamp + delayedSample) * level;
-        return delayedSample * level;
+        voices.setSustain(message.isSustainPedalOn(), release);
     }
+    else if (message.isAllNotesOff() || message.isAllSoundOff())
+    {
+        voices.releaseAll(release);
+    }
+}
 
-private:
-    bool active;
-    static const size_t maxNumChannels{ 2 };
-    std::array<DelayLine, maxNumChannels> delayLines;
-    float feedback{ 0.0f };
-    float level{ 0.0f };
-    size_t delayTimeSamples;
+void CombFilterBankAudioProcessor::retuneNotes() noexcept
+{
+    auto& map = delayMaps[(size_t) frontMap];
+    auto glideSamples = (size_t) (smoothingSeconds * bankSampleRate);
+    auto retuned = false;
 
-    std::array<juce::dsp::IIR::Filter<double>, maxNumChannels> filters;
-    typename juce::dsp::IIR::Coefficients<double>::Ptr coefs;
+    // a note the new tuning leaves out stays where it was, and moves again with the next tuning that has it
+    for (size_t comb = 0; comb < combNotes.size(); ++comb)
+    {
+        if (! map.isMapped(combNotes[comb])) continue;
 
-    double sampleRate{ 44.1e3 }; //need to update if I make sample rate contingent on DAW settings
-};
+        bank.glideDelay(comb, map.getDelay(combNotes[comb]), glideSamples);
+        retuned = true;
+    }
+
+    if (retuned)
+        bankChanged();
+}
 
 //==============================================================================
-//why is this happy to come after private classes when editor isn't??
-CombFilterBankAudioProcessor::CombFilterBankAudioProcessor() 
-    : AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo())
-                                      .withOutput("Output", juce::AudioChannelSet::stereo()))
+void CombFilterBankAudioProcessor::setTuning (const Tuning& newTuning)
 {
-    bypass = true;
-    LPActive = false;
-    HPActive = false;
-    combs.resize(4);
-    for (size_t i = 0; i < 4; ++i) combs[i] = Comb();
+    const juce::ScopedLock lock (tuningLock);
+    tuning = newTuning;
+
+    // saved as the text it was loaded from, so a session comes back with exactly the same tuning
+    parameters.state.setProperty("tuningScale", tuning.getScale(), nullptr);
+    parameters.state.setProperty("tuningMapping", tuning.getKeyboardMapping(), nullptr);
+
+    publishDelayMap();
 }
 
-CombFilterBankAudioProcessor::~CombFilterBankAudioProcessor()
+Tuning CombFilterBankAudioProcessor::getTuning() const
 {
+    const juce::ScopedLock lock (tuningLock);
+    return tuning;
 }
 
-//==============================================================================
-const juce::String CombFilterBankAudioProcessor::getName() const { return JucePlugin_Name; }
-bool CombFilterBankAudioProcessor::acceptsMidi() const { return false; }
-bool CombFilterBankAudioProcessor::producesMidi() const { return false; }
-bool CombFilterBankAudioProcessor::isMidiEffect() const { return false; }
-double CombFilterBankAudioProcessor::getTailLengthSeconds() const { return 0.0; }
-int CombFilterBankAudioProcessor::getNumPrograms() { return 1; }
-int CombFilterBankAudioProcessor::getCurrentProgram() { return 0; }
-void CombFilterBankAudioProcessor::setCurrentProgram (int index) {}
-const juce::String CombFilterBankAudioProcessor::getProgramName(int index) { return {}; }
-void CombFilterBankAudioProcessor::changeProgramName (int index, const juce::String& newName) {}
+float CombFilterBankAudioProcessor::getNotePitch (int note) const
+{
+    const juce::ScopedLock lock (tuningLock);
+    return tuning.isMapped(note) ? juce::jlimit(CombBank::minPitchHz, maxPitchHz, (float) tuning.getFrequency(note)) : 0.0f;
+}
 
-//==============================================================================
-void CombFilterBankAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
+void CombFilterBankAudioProcessor::publishDelayMap()
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    // before the first prepareToPlay() there is no rate to work delays out for, and prepareToPlay()
+    // builds the map itself
+    if (getSampleRate() <= 0.0) return;
+
+    delayMaps[(size_t) backMap].build(tuning, bankSampleRate, CombBank::minPitchHz, maxPitchHz);
+    backMap = middleMap.exchange(backMap | freshMap, std::memory_order_acq_rel) & ~freshMap;
+}
+
+void CombFilterBankAudioProcessor::bankChanged() noexcept
+{
+    ++bankGeneration;
+    samplesSinceChange = 0;
+    convolver.stop();
+}
+
+void CombFilterBankAudioProcessor::updateConvolver (size_t numSamples, float inputPeak) noexcept
+{
+    if (! convolver.isPrepared()) return;
+
+    // a ramp or crossfade still under way is a change that hasn't finished yet
+    samplesSinceChange = bank.isRamping() ? 0 : samplesSinceChange + numSamples;
+
+    // input loud enough to bend the saturator goes to the combs, which model it
+    if (convolver.hasImpulseFor(bankGeneration))
+    {
+        if (convolver.isLinearFor(inputPeak))
+            convolver.start();
+        else
+            convolver.stop();
+    }
+    else if (requestedGeneration != bankGeneration && samplesSinceChange >= (size_t) (settleSeconds * getSampleRate()))
+    {
+        // offline the capture runs in line, so a render comes out the same every time
+        if (convolver.requestCapture(bank, bankGeneration, isNonRealtime()))
+            requestedGeneration = bankGeneration;
+    }
 }
 
 void CombFilterBankAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    // no point keeping threads spinning while nothing is playing
+    bank.setWorkerPool(nullptr);
+    workers.stop();
+    convolver.release();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -183,12 +530,8 @@ bool CombFilterBankAudioProcessor::isBusesLayoutSupported (const BusesLayout& la
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    auto output = layouts.getMainOutputChannelSet();
+    if (output.isDisabled() || output != getChannelSetFor(output.size()))
         return false;
 
     // This checks if the input layout matches the output layout
@@ -202,9 +545,32 @@ bool CombFilterBankAudioProcessor::isBusesLayoutSupported (const BusesLayout& la
 }
 #endif
 
+// every channel runs through the same combs, so anything up to third-order ambisonics works
+juce::AudioChannelSet CombFilterBankAudioProcessor::getChannelSetFor (int numChannels)
+{
+    switch (numChannels)
+    {
+        case 1:  return juce::AudioChannelSet::mono();
+        case 2:  return juce::AudioChannelSet::stereo();
+        case 4:  return juce::AudioChannelSet::ambisonic(1);
+        case 6:  return juce::AudioChannelSet::create5point1();
+        case 8:  return juce::AudioChannelSet::create7point1();
+        case 9:  return juce::AudioChannelSet::ambisonic(2);
+        case 16: return juce::AudioChannelSet::ambisonic(3);
+        default: return {};
+    }
+}
+
 void CombFilterBankAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    // before prepareToPlay(), or after one with no block size, there is no scratch to cut the block
+    // into pieces of, so it passes through dry
+    if (wetBuffer.getNumSamples() == 0)
+        return;
+
     juce::ScopedNoDenormals noDenormals;
+    RealtimeGuard::ScopedAudioCallback realtimeGuard;
+    LoadMeter::ScopedTimer loadTimer (loadMeter, buffer.getNumSamples());
 
     auto mainInputOutput = getBusBuffer(buffer, true, 0);
 
@@ -212,38 +578,177 @@ void CombFilterBankAudioProcessor::processBlock (juce::AudioBuffer<float>& buffe
     //for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         //buffer.clear (i, 0, buffer.getNumSamples());
 
-     // This is the place where you'd normally do the guts of your plugin's
-    // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    // Alternatively, you can process the samples with the channels
-    // interleaved by keeping the same state.
-    for (size_t channel = 0; channel < mainInputOutput.getNumChannels(); ++channel)
-    {       
-        //attempt at combing 
-        float combedSamps[4] = {0.0f, 0.0f, 0.0f, 0.0f};
-        for (size_t samp = 0; samp < buffer.getNumSamples(); ++samp)
+    auto bypassed = bypassParameter->load() >= 0.5f;
+    auto numSamples = (size_t) mainInputOutput.getNumSamples();
+    auto maxChunk = (size_t) wetBuffer.getNumSamples();
+
+    auto midiEvents = midiMessages.cbegin();
+    auto midiEnd = midiMessages.cend();
+
+    // the block is cut at every tick of the control grid, at every note so that each lands on its own
+    // sample, and into scratch-sized pieces for hosts that hand us more than samplesPerBlock. Nothing
+    // inside a piece checks for any of them. Bypassed, the ticks and notes still run so nothing
+    // jumps when it comes back
+    for (size_t start = 0; start < numSamples;)
+    {
+        if (samplesUntilControl == 0)
+            runControl();
+
+        midiEvents = handleMidiUntil(midiEvents, midiEnd, (int) start);
+
+        auto end = start + juce::jmin(numSamples - start, samplesUntilControl, maxChunk);
+        if (midiEvents != midiEnd)
+            end = juce::jmin(end, (size_t) (*midiEvents).samplePosition);
+
+        // bypassed, the dry signal still runs the latency the host is compensating for
+        if (! bypassed)
+            processChunk(mainInputOutput, start, end - start);
+        else
+            decimator.delayDry(mainInputOutput, start, end - start);
+
+        samplesUntilControl -= end - start;
+        start = end;
+    }
+
+    // anything stamped past the end of the block still lands, just late
+    handleMidiUntil(midiEvents, midiEnd, std::numeric_limits<int>::max());
+
+    pushToAnalyzer(mainInputOutput);
+}
+
+void CombFilterBankAudioProcessor::processChunk (juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept
+{
+    // the gains apply with one multiply per channel while steady and per sample only while ramping
+    applyRamp(preGainRamp, buffer, start, numSamples);
+
+    auto balanceDivisor = bank.getNumActiveCombs();
+    auto wetScale = balanceDivisor > 0 ? 1.0f / (float) balanceDivisor : 0.0f;
+    auto numChannels = (size_t) juce::jmin(buffer.getNumChannels(), wetBuffer.getNumChannels());
+
+    auto inputPeak = 0.0f;
+    for (size_t channel = 0; channel < numChannels; ++channel)
+        inputPeak = juce::jmax(inputPeak, buffer.getMagnitude((int) channel, (int) start, (int) numSamples));
+
+    // unlike the rest of the control work this has to see every piece's input before it is processed,
+    // so anything loud enough to bend the saturator goes to the combs
+    updateConvolver(numSamples, inputPeak);
+
+    // with nothing coming in and nothing left ringing the bank would only add silence, so the lines
+    // are left as they are and only the dry path runs until something arrives. What the bank has taken
+    // since the last tick isn't in the tail bounds yet, so it counts as ringing too
+    if (inputPeak <= TailTracker::silenceThreshold && intervalPeak <= TailTracker::silenceThreshold
+        && ! tailsRinging && ! convolver.isRinging())
+    {
+        auto intervalStart = controlInterval - samplesUntilControl;
+        decimator.delayDry(buffer, start, numSamples);
+        buffer.applyGain((int) start, (int) numSamples, 1.0f - wetRamp.getValue(intervalStart + numSamples));
+        applyRamp(gainRamp, buffer, start, numSamples);
+        return;
+    }
+
+    // while the convolution has the input the bank only rings out what it already holds
+    auto convolving = convolver.isRunning();
+    intervalPeak = juce::jmax(intervalPeak, convolving ? 0.0f : inputPeak);
+    intervalSamples += numSamples;
+
+    std::array<const float*, CombBank::maxNumChannels> in {};
+    std::array<const float*, CombBank::maxNumChannels> silent {};
+    std::array<float*, CombBank::maxNumChannels> wet {};
+    for (size_t channel = 0; channel < numChannels; ++channel)
+    {
+        in[channel] = buffer.getReadPointer((int) channel, (int) start);
+        silent[channel] = convolving ? silentInput.getReadPointer((int) channel) : nullptr;
+        wet[channel] = wetBuffer.getWritePointer((int) channel);
+        juce::FloatVectorOperations::clear(wet[channel], (int) numSamples);
+    }
+
+    // decimated, the convolution gets the lower rate too, since its impulse was captured there. Its
+    // silent input is sized for the lower rate's blocks
+    auto runBank = [&] (const float* const* bankInput, float* const* bankWet, size_t numBankSamples)
+    {
+        bank.process(convolving ? silent.data() : bankInput, bankWet, numChannels, numBankSamples);
+        convolver.process(bankInput, bankWet, numChannels, numBankSamples);
+    };
+
+    if (decimator.isActive())
+        decimator.process(in.data(), wet.data(), numChannels, numSamples, runBank);
+    else
+        runBank(in.data(), wet.data(), numSamples);
+
+    // the wet has come through the resamplers, so the dry waits for it before they are mixed
+    decimator.delayDry(buffer, start, numSamples);
+
+    // one ramp shared by every channel, so it is only worked out while it is moving
+    auto wetIsRamping = fillRamp(wetRamp, numSamples);
+    auto steadyWet = wetRamp.to;
+
+    for (size_t channel = 0; channel < numChannels; ++channel)
+    {
+        auto* io = buffer.getWritePointer((int) channel, (int) start);
+
+        //output into buffer, balancing with input based on current wet/dry
+        if (wetIsRamping)
         {
-            float wetSamp = 0.0f;
-            size_t balanceDivisor = 0;
-            for (size_t c = 0; c < 4; ++c)
-            {
-                combedSamps[c] = 0.0f;
-                if (combs[c].isActive()) 
-                {
-                    balanceDivisor++;
-                    //I need to figure out how I'm getting data back if not passing a context?
-                    combedSamps[c] = combs[c].processSample(channel, *mainInputOutput.getReadPointer(channel, samp));
-                }
-                //add samples to output
-                wetSamp += combedSamps[c];
-            }
-            wetSamp /= balanceDivisor;
-            //output the sample into buffer here, balancing with input based on current wet/dry
-            float wetLevel = 0.5f; //hard coded 50% wet for now until I link slider
-            *mainInputOutput.getWritePointer(channel, samp) = *mainInputOutput.getReadPointer(channel, samp) * (1.0f - wetLevel) + wetSamp * wetLevel;
+            // io += (wet - io) * ramp, done in the wet row
+            juce::FloatVectorOperations::multiply(wet[channel], wetScale, (int) numSamples);
+            juce::FloatVectorOperations::subtract(wet[channel], io, (int) numSamples);
+            juce::FloatVectorOperations::multiply(wet[channel], rampBuffer.data(), (int) numSamples);
+            juce::FloatVectorOperations::add(io, wet[channel], (int) numSamples);
+        }
+        else
+        {
+            juce::FloatVectorOperations::multiply(io, 1.0f - steadyWet, (int) numSamples);
+            juce::FloatVectorOperations::addWithMultiply(io, wet[channel], steadyWet * wetScale, (int) numSamples);
         }
     }
+
+    applyRamp(gainRamp, buffer, start, numSamples);
+}
+
+bool CombFilterBankAudioProcessor::fillRamp (const ControlRamp& ramp, size_t numSamples) noexcept
+{
+    if (! ramp.isMoving()) return false;
+
+    // the piece starts partway into the interval wherever a note or the block boundary cut it
+    auto intervalStart = controlInterval - samplesUntilControl;
+    for (size_t i = 0; i < numSamples; ++i)
+        rampBuffer[i] = ramp.getValue(intervalStart + i + 1);
+
+    return true;
+}
+
+void CombFilterBankAudioProcessor::applyRamp (const ControlRamp& ramp, juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept
+{
+    if (! fillRamp(ramp, numSamples))
+    {
+        buffer.applyGain((int) start, (int) numSamples, ramp.to);
+        return;
+    }
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        juce::FloatVectorOperations::multiply(buffer.getWritePointer(channel, (int) start), rampBuffer.data(), (int) numSamples);
+}
+
+void CombFilterBankAudioProcessor::pushToAnalyzer (const juce::AudioBuffer<float>& buffer) noexcept
+{
+    if (numAnalyzers.load(std::memory_order_relaxed) <= 0 || buffer.getNumChannels() == 0) return;
+
+    auto numChannels = buffer.getNumChannels();
+    auto maxChunk = (int) analyzerMix.size();
+
+    for (int start = 0; start < buffer.getNumSamples(); start += maxChunk)
+    {
+        auto chunk = juce::jmin(maxChunk, buffer.getNumSamples() - start);
+
+        juce::FloatVectorOperations::copy(analyzerMix.data(), buffer.getReadPointer(0, start), chunk);
+        for (int channel = 1; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::add(analyzerMix.data(), buffer.getReadPointer(channel, start), chunk);
+
+        juce::FloatVectorOperations::multiply(analyzerMix.data(), 1.0f / (float) numChannels, chunk);
+
+        // if the analyzer has fallen behind the rest is simply dropped
+        analyzerFifo.push(analyzerMix.data(), chunk);
+    }
 }
 
 //==============================================================================
@@ -260,15 +765,27 @@ juce::AudioProcessorEditor* CombFilterBankAudioProcessor::createEditor()
 //==============================================================================
 void CombFilterBankAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    auto state = parameters.copyState();
+    std::unique_ptr<juce::XmlElement> xml (state.createXml());
+    copyXmlToBinary(*xml, destData);
 }
 
 void CombFilterBankAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    std::unique_ptr<juce::XmlElement> xml (getXmlFromBinary(data, sizeInBytes));
+
+    if (xml != nullptr && xml->hasTagName(parameters.state.getType()))
+    {
+        parameters.replaceState(juce::ValueTree::fromXml(*xml));
+
+        // a session saved without a tuning, or with one that no longer loads, gets equal temperament
+        Tuning restored;
+        auto scale = parameters.state.getProperty("tuningScale").toString();
+        if (scale.isNotEmpty())
+            restored.loadScala(scale, parameters.state.getProperty("tuningMapping").toString());
+
+        setTuning(restored);
+    }
 }
 
 //==============================================================================
@@ -9,6 +9,16 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "BankConvolver.h"
+#include "BankDecimator.h"
+#include "CombBank.h"
+#include "CommandFifo.h"
+#include "LoadMeter.h"
+#include "RealtimeGuard.h"
+#include "SampleFifo.h"
+#include "TailTracker.h"
+#include "Tuning.h"
+#include "VoiceAllocator.h"
 
 //==============================================================================
 /**
@@ -17,9 +27,107 @@ class CombFilterBankAudioProcessor  : public juce::AudioProcessor
 {
 public:
     //==============================================================================
-    CombFilterBankAudioProcessor();
+    explicit CombFilterBankAudioProcessor (size_t numCombs = CombBank::defaultNumCombs);
     ~CombFilterBankAudioProcessor() override;
 
+    /** The bank is reallocated at the next prepareToPlay(), never while processing. */
+    void setNumCombs (size_t newNumCombs) noexcept { requestedNumCombs = newNumCombs; }
+    size_t getNumCombs() const noexcept { return bank.getNumCombs(); }
+    size_t getBankMemoryFootprint() const noexcept { return bank.getMemoryFootprint(); }
+
+    /** Threads that share the bank with the audio thread, started at the next prepareToPlay().
+        Only worth it for banks of many dozens of combs; zero runs everything on the audio thread.
+    */
+    void setNumWorkerThreads (size_t newNumWorkers) noexcept { requestedNumWorkers = newNumWorkers; }
+    size_t getNumWorkerThreads() const noexcept { return workers.getNumWorkers(); }
+
+    /** Lets a dense bank whose settings have held still for settleSeconds hand its input over to a
+        convolution with its captured impulse response, and take it back as soon as anything moves.
+        Takes effect at the next prepareToPlay(). The convolution leaves out the saturator, so it
+        only matches the combs while their lines stay well inside full scale, and louder input
+        goes back to the combs.
+    */
+    void setConvolutionMode (bool shouldUseConvolution) noexcept { convolutionRequested = shouldUseConvolution; }
+    bool getConvolutionMode() const noexcept { return convolutionRequested; }
+    bool isConvolving() const noexcept { return convolver.isRunning(); }
+
+    /** Runs the bank at 44.1 or 48 kHz when the host is at twice that or more, behind half-band
+        resamplers, for a half or less of the memory and work. Takes effect at the next prepareToPlay(),
+        which reports the resamplers' latency to the host. Everything the combs can play is well
+        inside the lower rate, so only wet content above about 20 kHz is lost.
+    */
+    void setDecimationMode (bool shouldDecimate) noexcept { decimationRequested = shouldDecimate; }
+    bool getDecimationMode() const noexcept { return decimationRequested; }
+
+    /** What the host rate is divided by for the bank, 1 while it runs at the host rate. */
+    size_t getDecimationFactor() const noexcept { return decimator.getFactor(); }
+
+    /** How long each block took against the time it lasts, for the editor's DSP load meter. */
+    LoadMeter& getLoadMeter() noexcept { return loadMeter; }
+
+    /** A mono mix of the output for the editor's spectrum analyzer, only filled while one is listening.
+        Each analyzer calls addAnalyzer() when it opens and removeAnalyzer() when it closes.
+    */
+    SampleFifo& getAnalyzerFifo() noexcept { return analyzerFifo; }
+    void addAnalyzer() noexcept { ++numAnalyzers; }
+    void removeAnalyzer() noexcept { --numAnalyzers; }
+
+    //==============================================================================
+    /** Swaps in a new tuning. Its delay map is built here for the current sample rate, and the audio
+        thread picks it up at the start of its next block, retuning every comb that is playing a note
+        with one lookup each. Call from the message thread only.
+    */
+    void setTuning (const Tuning& newTuning);
+    Tuning getTuning() const;
+
+    /** What a comb set to this note plays under the current tuning, or 0 if the tuning leaves it out. */
+    float getNotePitch (int note) const;
+
+    //==============================================================================
+    /** Global parameters plus pitch, feedback, level and active for each of the first numCombs combs.
+        With MIDI Notes on, the active combs are voices: a note-on tunes one to the note with its level
+        set by the velocity times its Level, and a note-off fades it out while its line rings on.
+    */
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout (size_t numCombs);
+    static juce::String getCombParameterID (size_t comb, const juce::String& name);
+
+    juce::AudioProcessorValueTreeState& getValueTreeState() noexcept { return parameters; }
+    size_t getNumParameterCombs() const noexcept { return combParameters.size(); }
+    juce::AudioProcessorParameter* getBypassParameter() const override;
+
+    static constexpr float maxPitchHz = 8372.02f; // C9
+    static constexpr double smoothingSeconds = 0.05;
+    static constexpr double crossfadeSeconds = 0.01;
+    static constexpr double settleSeconds = 0.5;
+
+    /** Parameters, commands, smoothing and tail tracking run once every controlInterval samples, on a
+        grid that carries on across blocks, so how often they run doesn't depend on the host's buffer size.
+    */
+    static constexpr size_t controlInterval = 32;
+
+    //==============================================================================
+    /** A structural edit to one comb, applied at the start of the next block with a crossfade, or a glide for a pitch. */
+    struct BankCommand
+    {
+        enum class Type
+        {
+            setActive,
+            toggleActive,
+            setPitch,
+            setNote,
+            reset
+        };
+
+        Type type;
+        size_t comb;
+        float value; // 0 or 1 for setActive, Hz for setPitch, the MIDI note for setNote
+    };
+
+    /** Call from the message thread only; the audio thread is the single consumer.
+        Returns false if the queue is full and the command was dropped.
+    */
+    bool pushCommand (const BankCommand& command) noexcept { return commands.push(command); }
+
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
@@ -28,6 +136,9 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
    #endif
 
+    /** The layout isBusesLayoutSupported() accepts with this many channels, or an empty set if none. */
+    static juce::AudioChannelSet getChannelSetFor (int numChannels);
+
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
     //==============================================================================
@@ -54,11 +165,140 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
 private:
-    bool bypass;
-    bool LPActive, HPActive;
-    class DelayLine;
-    class Comb;
-    std::vector<Comb> combs;
+    /** The work due at each tick of the control grid: the tail bounds for the interval just gone, a new
+        tuning, the editor's commands, the parameters and the next step of every smoother.
+    */
+    void runControl() noexcept;
+
+    /** Works out the tail getTailLengthSeconds() reports from the bank's combs as they are now. */
+    void updateTailLength() noexcept;
+
+    /** Pulls the latest parameter values into the smoothers and the bank, once per control interval. */
+    void updateParameters() noexcept;
+    void applyCommand (const BankCommand& command) noexcept;
+
+    /** Applies every MIDI event up to and including sample, and returns the first one after it. */
+    juce::MidiBufferIterator handleMidiUntil (juce::MidiBufferIterator event, juce::MidiBufferIterator end, int sample) noexcept;
+    void handleMidiEvent (const juce::MidiMessage& message) noexcept;
+
+    /** Builds the back map from the tuning and hands it to the audio thread. Call with tuningLock held. */
+    void publishDelayMap();
+
+    /** Moves every comb playing a note to where the front map puts it. */
+    void retuneNotes() noexcept;
+    void pushToAnalyzer (const juce::AudioBuffer<float>& buffer) noexcept;
+
+    /** Runs a piece of the block that sits inside one control interval and holds no MIDI events. */
+    void processChunk (juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept;
+
+    /** Anything that changes the bank's impulse response calls this, so the convolution stops. */
+    void bankChanged() noexcept;
+    void updateConvolver (size_t numSamples, float inputPeak) noexcept;
+
+    // the host and the editor write the atomics, the audio thread only ever reads them
+    struct CombParameters
+    {
+        std::atomic<float>* pitch = nullptr;
+        std::atomic<float>* feedback = nullptr;
+        std::atomic<float>* level = nullptr;
+        std::atomic<float>* active = nullptr;
+
+        // pitch and active changes become crossfaded bank commands, feedback and level
+        // are ramped sample by sample inside the bank
+        float lastPitch = 0.0f, lastFeedback = 0.0f, lastLevel = 0.0f;
+        bool lastActive = false;
+    };
+
+    size_t requestedNumCombs;
+    size_t requestedNumWorkers = 0;
+    bool convolutionRequested = false;
+    bool decimationRequested = false;
+
+    // declared first so it outlives the bank that points at it
+    WorkerPool workers;
+    CombBank bank;
+
+    juce::AudioProcessorValueTreeState parameters;
+    std::atomic<float>* bypassParameter = nullptr;
+    std::atomic<float>* preGainParameter = nullptr;
+    std::atomic<float>* gainParameter = nullptr;
+    std::atomic<float>* wetParameter = nullptr;
+    std::atomic<float>* midiNotesParameter = nullptr;
+    std::atomic<float>* voiceAllocationParameter = nullptr;
+    std::vector<CombParameters> combParameters;
+    CommandFifo<BankCommand, 256> commands;
+
+    // a smoother stepped once per control interval, and drawn as a straight line in between
+    struct ControlRamp
+    {
+        float from = 0.0f, to = 0.0f;
+
+        void reset (float value) noexcept { from = to = value; }
+        void step (juce::SmoothedValue<float>& value) noexcept { from = to; to = value.skip((int) controlInterval); }
+        bool isMoving() const noexcept { return from != to; }
+
+        // sample counts from the start of the interval, so the last one lands on to
+        float getValue (size_t sample) const noexcept { return from + (to - from) * (float) sample / (float) controlInterval; }
+    };
+
+    /** Fills rampBuffer with the ramp's next numSamples values, or returns false while it is flat. */
+    bool fillRamp (const ControlRamp& ramp, size_t numSamples) noexcept;
+    void applyRamp (const ControlRamp& ramp, juce::AudioBuffer<float>& buffer, size_t start, size_t numSamples) noexcept;
+
+    juce::SmoothedValue<float> preGain, gain, wetLevel;
+    ControlRamp preGainRamp, gainRamp, wetRamp;
+    juce::AudioBuffer<float> wetBuffer;
+    std::vector<float> rampBuffer;
+
+    // where the grid has got to, and the input peak and length of what the bank has run since the last
+    // tick, which go to the tail bounds at the next one
+    size_t samplesUntilControl = 0;
+    float intervalPeak = 0.0f;
+    size_t intervalSamples = 0;
+    bool tailsRinging = false;
+    TailTracker tails;
+
+    // the ring-out of the bank as of the generation it was worked out for, for any thread to read
+    std::atomic<double> tailLengthSeconds { 0.0 };
+    juce::uint32 tailGeneration = 0;
+
+    // the rate the bank and the convolution run at, which every ramp and delay is counted in
+    BankDecimator decimator;
+    double bankSampleRate = 44.1e3;
+
+    // bumped by every change to the bank, so a capture of older settings is never started.
+    // silentInput is what the bank is fed while the convolution has the input
+    BankConvolver convolver;
+    juce::uint32 bankGeneration = 0, requestedGeneration = 0;
+    size_t samplesSinceChange = 0;
+    juce::AudioBuffer<float> silentInput;
+
+    // the editor and prepareToPlay() read the tuning while the message thread may be replacing it
+    juce::CriticalSection tuningLock;
+    Tuning tuning;
+
+    // three maps passed between the threads without a lock. The message thread builds the back one
+    // and swaps it into the middle marked fresh, and the audio thread swaps a fresh middle one for
+    // its front one
+    std::array<NoteDelayMap, 3> delayMaps;
+    int frontMap = 0, backMap = 1;
+    std::atomic<int> middleMap { 2 };
+    static constexpr int freshMap = 4;
+
+    // the note each comb was last set to, or noNote once its pitch is set in Hz. Audio thread only
+    static constexpr int noNote = -1;
+    std::vector<int> combNotes;
+
+    // which comb plays each MIDI note, while MIDI Notes is on. Audio thread only
+    VoiceAllocator voices;
+    bool lastMidiNotes = false;
+
+    LoadMeter loadMeter;
+
+    // about 170 ms at 192 kHz, several times what the analyzer takes between frames
+    SampleFifo analyzerFifo { 1 << 15 };
+    std::atomic<int> numAnalyzers { 0 };
+    std::vector<float> analyzerMix;
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CombFilterBankAudioProcessor)
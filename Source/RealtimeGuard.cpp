@@ -0,0 +1,239 @@
+/*
+  ==============================================================================
+
+    RealtimeGuard.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeGuard.h"
+
+#if COMBFILTERBANK_REALTIME_CHECKS
+
+#include <new>
+
+#if JUCE_WINDOWS
+ #include <malloc.h>
+#endif
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <sched.h>
+ #include <time.h>
+ #include <unistd.h>
+#endif
+
+//==============================================================================
+namespace RealtimeGuard
+{
+    namespace
+    {
+        // both are constant-initialised, so touching them never runs code that could allocate
+        thread_local bool inAudioCallback = false;
+        thread_local Counts callbackCounts;
+
+        std::atomic<juce::uint32> numViolatingCallbacks { 0 };
+    }
+
+    ScopedAudioCallback::ScopedAudioCallback() noexcept
+    {
+        callbackCounts = {};
+        inAudioCallback = true;
+    }
+
+    ScopedAudioCallback::~ScopedAudioCallback()
+    {
+        inAudioCallback = false;
+
+        if (callbackCounts.any())
+        {
+            ++numViolatingCallbacks;
+
+            DBG("audio callback made " << (int) callbackCounts.allocations << " allocations, "
+                << (int) callbackCounts.deallocations << " frees, " << (int) callbackCounts.locks << " locks and "
+                << (int) callbackCounts.systemCalls << " blocking system calls");
+
+            // something on the audio thread can block. Break here, then step back into the callback
+            // with a breakpoint on the hook that counted it to see who
+            jassertfalse;
+        }
+    }
+
+    Counts* getCurrentCounts() noexcept
+    {
+        return inAudioCallback ? &callbackCounts : nullptr;
+    }
+
+    juce::uint32 getNumViolatingCallbacks() noexcept
+    {
+        return numViolatingCallbacks.load();
+    }
+}
+
+//==============================================================================
+namespace
+{
+    void* allocate(std::size_t size, std::size_t alignment = 0) noexcept
+    {
+        if (auto* counts = RealtimeGuard::getCurrentCounts())
+            ++counts->allocations;
+
+        size = juce::jmax(size, (std::size_t) 1);
+
+        if (alignment == 0)
+            return std::malloc(size);
+
+       #if JUCE_WINDOWS
+        return _aligned_malloc(size, alignment);
+       #else
+        return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+       #endif
+    }
+
+    void release(void* pointer, bool aligned = false) noexcept
+    {
+        if (pointer == nullptr) return;
+
+        if (auto* counts = RealtimeGuard::getCurrentCounts())
+            ++counts->deallocations;
+
+       #if JUCE_WINDOWS
+        if (aligned)
+        {
+            _aligned_free(pointer);
+            return;
+        }
+       #else
+        juce::ignoreUnused(aligned);
+       #endif
+
+        std::free(pointer);
+    }
+
+    void* allocateOrThrow(std::size_t size, std::size_t alignment = 0)
+    {
+        if (auto* pointer = allocate(size, alignment))
+            return pointer;
+
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new (std::size_t size)                                           { return allocateOrThrow(size); }
+void* operator new[] (std::size_t size)                                         { return allocateOrThrow(size); }
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept           { return allocate(size); }
+void* operator new[] (std::size_t size, const std::nothrow_t&) noexcept         { return allocate(size); }
+void* operator new (std::size_t size, std::align_val_t alignment)               { return allocateOrThrow(size, (std::size_t) alignment); }
+void* operator new[] (std::size_t size, std::align_val_t alignment)             { return allocateOrThrow(size, (std::size_t) alignment); }
+
+void operator delete (void* pointer) noexcept                                   { release(pointer); }
+void operator delete[] (void* pointer) noexcept                                 { release(pointer); }
+void operator delete (void* pointer, std::size_t) noexcept                      { release(pointer); }
+void operator delete[] (void* pointer, std::size_t) noexcept                    { release(pointer); }
+void operator delete (void* pointer, std::align_val_t) noexcept                 { release(pointer, true); }
+void operator delete[] (void* pointer, std::align_val_t) noexcept               { release(pointer, true); }
+void operator delete (void* pointer, std::size_t, std::align_val_t) noexcept    { release(pointer, true); }
+void operator delete[] (void* pointer, std::size_t, std::align_val_t) noexcept  { release(pointer, true); }
+
+//==============================================================================
+#if JUCE_LINUX
+namespace
+{
+    // looked up on first use rather than in a function-local static, whose guard could take a lock
+    template <typename Function>
+    Function* getNext(std::atomic<Function*>& cache, const char* name) noexcept
+    {
+        auto* function = cache.load(std::memory_order_relaxed);
+
+        if (function == nullptr)
+        {
+            function = reinterpret_cast<Function*>(dlsym(RTLD_NEXT, name));
+            cache.store(function, std::memory_order_relaxed);
+        }
+
+        return function;
+    }
+
+    void countLock() noexcept
+    {
+        if (auto* counts = RealtimeGuard::getCurrentCounts())
+            ++counts->locks;
+    }
+
+    void countSystemCall() noexcept
+    {
+        if (auto* counts = RealtimeGuard::getCurrentCounts())
+            ++counts->systemCalls;
+    }
+
+    std::atomic<int (*)(pthread_mutex_t*)> nextMutexLock { nullptr };
+    std::atomic<int (*)(pthread_rwlock_t*)> nextReadLock { nullptr }, nextWriteLock { nullptr };
+    std::atomic<int (*)(pthread_cond_t*, pthread_mutex_t*)> nextConditionWait { nullptr };
+    std::atomic<ssize_t (*)(int, void*, size_t)> nextRead { nullptr };
+    std::atomic<ssize_t (*)(int, const void*, size_t)> nextWrite { nullptr };
+    std::atomic<int (*)(const timespec*, timespec*)> nextNanosleep { nullptr };
+    std::atomic<int (*)(useconds_t)> nextUsleep { nullptr };
+    std::atomic<int (*)()> nextYield { nullptr };
+}
+
+// the same exception specifications as glibc's declarations
+extern "C"
+{
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        countLock();
+        return getNext(nextMutexLock, "pthread_mutex_lock")(mutex);
+    }
+
+    int pthread_rwlock_rdlock(pthread_rwlock_t* lock) noexcept
+    {
+        countLock();
+        return getNext(nextReadLock, "pthread_rwlock_rdlock")(lock);
+    }
+
+    int pthread_rwlock_wrlock(pthread_rwlock_t* lock) noexcept
+    {
+        countLock();
+        return getNext(nextWriteLock, "pthread_rwlock_wrlock")(lock);
+    }
+
+    int pthread_cond_wait(pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        countLock();
+        return getNext(nextConditionWait, "pthread_cond_wait")(condition, mutex);
+    }
+
+    ssize_t read(int fd, void* buffer, size_t size)
+    {
+        countSystemCall();
+        return getNext(nextRead, "read")(fd, buffer, size);
+    }
+
+    ssize_t write(int fd, const void* buffer, size_t size)
+    {
+        countSystemCall();
+        return getNext(nextWrite, "write")(fd, buffer, size);
+    }
+
+    int nanosleep(const timespec* duration, timespec* remaining)
+    {
+        countSystemCall();
+        return getNext(nextNanosleep, "nanosleep")(duration, remaining);
+    }
+
+    int usleep(useconds_t microseconds)
+    {
+        countSystemCall();
+        return getNext(nextUsleep, "usleep")(microseconds);
+    }
+
+    int sched_yield() noexcept
+    {
+        countSystemCall();
+        return getNext(nextYield, "sched_yield")();
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  ==============================================================================
+
+    RealtimeGuard.h
+    Catches heap allocation, locking and blocking system calls on the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// on in debug builds unless the project says otherwise
+#ifndef COMBFILTERBANK_REALTIME_CHECKS
+ #define COMBFILTERBANK_REALTIME_CHECKS JUCE_DEBUG
+#endif
+
+//==============================================================================
+/**
+    While a thread holds a ScopedAudioCallback, every heap allocation and free, mutex lock and
+    blocking system call it makes is counted, and the callback asserts as it ends if any were.
+
+    Allocations are seen through replacement operator new and delete, so they are caught whichever
+    code made them. Locks and system calls are seen by interposing the pthread and libc functions
+    that make them, which only works on Linux and only for calls made from this binary.
+
+    Without COMBFILTERBANK_REALTIME_CHECKS nothing is hooked and ScopedAudioCallback is empty.
+*/
+namespace RealtimeGuard
+{
+    struct Counts
+    {
+        juce::uint32 allocations = 0, deallocations = 0, locks = 0, systemCalls = 0;
+
+        bool any() const noexcept { return allocations + deallocations + locks + systemCalls > 0; }
+    };
+
+   #if COMBFILTERBANK_REALTIME_CHECKS
+    class ScopedAudioCallback
+    {
+    public:
+        ScopedAudioCallback() noexcept;
+        ~ScopedAudioCallback();
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedAudioCallback)
+    };
+
+    /** The counts for the thread's current callback, or nullptr outside one. Used by the hooks. */
+    Counts* getCurrentCounts() noexcept;
+
+    /** Callbacks that made any of the calls above since the program started. */
+    juce::uint32 getNumViolatingCallbacks() noexcept;
+   #else
+    struct ScopedAudioCallback
+    {
+        ScopedAudioCallback() noexcept {}
+    };
+
+    inline juce::uint32 getNumViolatingCallbacks() noexcept { return 0; }
+   #endif
+}
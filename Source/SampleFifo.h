@@ -0,0 +1,65 @@
+/*
+  ==============================================================================
+
+    SampleFifo.h
+    Wait-free single-producer, single-consumer queue of audio samples.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    The audio thread pushes and one other thread pulls. Neither side locks, allocates or waits:
+    a push that doesn't fit drops what's left over rather than waiting for the reader to catch up.
+*/
+class SampleFifo
+{
+public:
+    explicit SampleFifo(int capacity) : fifo(capacity), samples((size_t) capacity) {}
+
+    /** Returns how many samples fit; the rest are dropped. */
+    int push(const float* source, int numSamples) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+        std::copy(source, source + size1, samples.data() + start1);
+        std::copy(source + size1, source + size1 + size2, samples.data() + start2);
+
+        fifo.finishedWrite(size1 + size2);
+        return size1 + size2;
+    }
+
+    /** Copies out up to maxSamples of the oldest samples and returns how many there were. */
+    int pull(float* dest, int maxSamples) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(maxSamples, start1, size1, start2, size2);
+
+        std::copy(samples.data() + start1, samples.data() + start1 + size1, dest);
+        std::copy(samples.data() + start2, samples.data() + start2 + size2, dest + size1);
+
+        fifo.finishedRead(size1 + size2);
+        return size1 + size2;
+    }
+
+    /** Throws away the oldest samples without copying them, for a reader that has fallen behind. */
+    void skip(int numSamples) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(numSamples, start1, size1, start2, size2);
+        fifo.finishedRead(size1 + size2);
+    }
+
+    int getNumReady() const noexcept { return fifo.getNumReady(); }
+
+private:
+    juce::AbstractFifo fifo;
+    std::vector<float> samples;
+
+    JUCE_DECLARE_NON_COPYABLE(SampleFifo)
+};
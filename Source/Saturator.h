@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    Saturator.h
+    tanh-shaped saturation curves for the comb feedback path.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Every curve works in place on a plain array with no branches in the loop body,
+    so the compiler can vectorise it across whatever the array holds: a group of combs,
+    a block of samples, or both channels.
+
+    Worst-case absolute error against std::tanh over all finite inputs:
+        exact     0 (calls std::tanh)
+        rational  9.6e-5  ([7/6] Pade approximant, input clamped to +-4.97)
+        table     2.4e-5  (1024 linear segments over +-8, flat beyond)
+
+    Both approximations stay inside [-1, 1], so they can't add energy to the feedback loop.
+*/
+struct Saturator
+{
+    enum class Type
+    {
+        exact,
+        rational,
+        table
+    };
+
+    template <Type type>
+    static void process(float* samples, size_t numSamples) noexcept
+    {
+        if constexpr (type == Type::exact)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                samples[i] = std::tanh(samples[i]);
+        }
+        else if constexpr (type == Type::rational)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                samples[i] = rational(samples[i]);
+        }
+        else
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                samples[i] = table(samples[i]);
+        }
+    }
+
+    static void process(Type type, float* samples, size_t numSamples) noexcept
+    {
+        switch (type)
+        {
+            case Type::exact:    process<Type::exact>(samples, numSamples); break;
+            case Type::rational: process<Type::rational>(samples, numSamples); break;
+            case Type::table:    process<Type::table>(samples, numSamples); break;
+        }
+    }
+
+    static float rational(float x) noexcept
+    {
+        // past the clamp the approximant would climb above 1
+        x = juce::jlimit(-rationalClamp, rationalClamp, x);
+        auto x2 = x * x;
+        return x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)))
+                 / (135135.0f + x2 * (62370.0f + x2 * (3150.0f + 28.0f * x2)));
+    }
+
+    static float table(float x) noexcept
+    {
+        auto position = (juce::jlimit(-tableRange, tableRange, x) + tableRange) * ((float) tableSize / (2.0f * tableRange));
+        auto index = juce::jmin((int) position, tableSize - 1);
+        auto frac = position - (float) index;
+        return lookupTable[(size_t) index] + frac * (lookupTable[(size_t) index + 1] - lookupTable[(size_t) index]);
+    }
+
+private:
+    static constexpr float rationalClamp = 4.97f;
+    static constexpr float tableRange = 8.0f;
+    static constexpr int tableSize = 1024;
+
+    static std::array<float, tableSize + 1> makeTable() noexcept
+    {
+        std::array<float, tableSize + 1> t;
+        for (size_t i = 0; i < t.size(); ++i)
+            t[i] = (float) std::tanh(-tableRange + 2.0 * tableRange * (double) i / (double) tableSize);
+        return t;
+    }
+
+    // built during static initialisation, never on the audio thread
+    inline static const std::array<float, tableSize + 1> lookupTable = makeTable();
+};
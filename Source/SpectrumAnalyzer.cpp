@@ -0,0 +1,198 @@
+/*
+  ==============================================================================
+
+    SpectrumAnalyzer.cpp
+
+  ==============================================================================
+*/
+
+#include "SpectrumAnalyzer.h"
+
+namespace
+{
+    // enough history for the oldest frame a tick can reach, rounded up to a power of two for masking
+    constexpr int historySize = 2 * SpectrumAnalyzer::fftSize;
+    static_assert(historySize >= SpectrumAnalyzer::fftSize + SpectrumAnalyzer::maxFramesPerTick * SpectrumAnalyzer::hopSize,
+                  "the history must reach back to the start of the oldest frame");
+
+    constexpr int pullChunk = 4096;
+}
+
+//==============================================================================
+SpectrumAnalyzer::SpectrumAnalyzer(CombFilterBankAudioProcessor& p)
+    : processor(p),
+      incoming((size_t) pullChunk),
+      history((size_t) historySize),
+      fftData((size_t) (2 * fftSize)),
+      powerSum((size_t) (fftSize / 2 + 1))
+{
+    levels.fill(minDecibels);
+
+    processor.addAnalyzer();
+    startTimerHz(framesPerSecond);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer()
+{
+    stopTimer();
+    processor.removeAnalyzer();
+}
+
+//==============================================================================
+void SpectrumAnalyzer::configure(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+
+    // 44.1 and 48 kHz are used as they are, 88.2 and 96 kHz halved, 176.4 and 192 kHz quartered
+    decimationFactor = juce::jmax(1, juce::roundToInt(sampleRate / 48000.0));
+    analysisRate = sampleRate / decimationFactor;
+    decimationPhase = 0;
+
+    if (decimationFactor > 1)
+        antiAliasFilter.coefficients = juce::dsp::FilterDesign<float>::designFIRLowpassWindowMethod(
+            (float) (analysisRate * 0.45), sampleRate, 63, juce::dsp::WindowingFunction<float>::blackman);
+
+    antiAliasFilter.reset();
+
+    std::fill(history.begin(), history.end(), 0.0f);
+    historyIndex = samplesSinceFrame = framesReady = 0;
+    levels.fill(minDecibels);
+}
+
+void SpectrumAnalyzer::timerCallback()
+{
+    auto currentRate = processor.getSampleRate();
+    if (currentRate <= 0.0) return;
+
+    if (currentRate != sampleRate)
+        configure(currentRate);
+
+    auto& fifo = processor.getAnalyzerFifo();
+
+    // only the most recent audio can reach this tick's frames, so anything older is dropped unread
+    auto wanted = (fftSize + maxFramesPerTick * hopSize) * decimationFactor;
+    auto excess = fifo.getNumReady() - wanted;
+    if (excess > 0)
+        fifo.skip(excess);
+
+    for (auto numPulled = fifo.pull(incoming.data(), pullChunk); numPulled > 0; numPulled = fifo.pull(incoming.data(), pullChunk))
+        for (int i = 0; i < numPulled; ++i)
+            addSample(incoming[(size_t) i]);
+
+    auto numFrames = juce::jmin(framesReady, maxFramesPerTick);
+    framesReady = 0;
+
+    // once everything has fallen to the floor with nothing new coming in there's nothing to redraw
+    auto wasSilent = std::all_of(levels.begin(), levels.end(), [](float level) { return level <= minDecibels; });
+    updateLevels(numFrames);
+
+    if (numFrames > 0 || ! wasSilent)
+        repaint();
+}
+
+void SpectrumAnalyzer::addSample(float sample) noexcept
+{
+    if (decimationFactor > 1)
+    {
+        sample = antiAliasFilter.processSample(sample);
+
+        if (++decimationPhase < decimationFactor) return;
+        decimationPhase = 0;
+    }
+
+    history[(size_t) historyIndex] = sample;
+    historyIndex = (historyIndex + 1) & (historySize - 1);
+
+    if (++samplesSinceFrame >= hopSize)
+    {
+        samplesSinceFrame = 0;
+        ++framesReady;
+    }
+}
+
+void SpectrumAnalyzer::addFrame(int framesBack) noexcept
+{
+    // frames end on hop boundaries, counting back from the newest complete one
+    auto start = historyIndex - samplesSinceFrame - framesBack * hopSize - fftSize;
+
+    for (int i = 0; i < fftSize; ++i)
+        fftData[(size_t) i] = history[(size_t) ((start + i) & (historySize - 1))];
+
+    std::fill(fftData.begin() + fftSize, fftData.end(), 0.0f);
+
+    window.multiplyWithWindowingTable(fftData.data(), (size_t) fftSize);
+    fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+    for (size_t bin = 0; bin < powerSum.size(); ++bin)
+        powerSum[bin] += fftData[bin] * fftData[bin];
+}
+
+void SpectrumAnalyzer::updateLevels(int numFrames) noexcept
+{
+    if (numFrames > 0)
+    {
+        std::fill(powerSum.begin(), powerSum.end(), 0.0f);
+
+        for (int frame = 0; frame < numFrames; ++frame)
+            addFrame(frame);
+    }
+
+    // a full-scale sine comes out of a Hann-windowed transform with a magnitude of fftSize / 4
+    auto fullScale = (float) fftSize / 4.0f;
+    auto scale = numFrames > 0 ? 1.0f / ((float) numFrames * fullScale * fullScale) : 0.0f;
+    auto maxFrequency = juce::jmin(20000.0f, (float) analysisRate * 0.5f);
+
+    for (int point = 0; point < numPoints; ++point)
+    {
+        auto target = minDecibels;
+
+        if (numFrames > 0)
+        {
+            auto frequency = minFrequency * std::pow(maxFrequency / minFrequency, (float) point / (float) (numPoints - 1));
+            auto bin = frequency * (float) fftSize / (float) analysisRate;
+            auto lower = juce::jmin((int) bin, fftSize / 2 - 1);
+            auto fraction = bin - (float) lower;
+
+            auto power = powerSum[(size_t) lower] + fraction * (powerSum[(size_t) lower + 1] - powerSum[(size_t) lower]);
+            target = juce::jmax(minDecibels, 10.0f * std::log10(power * scale + 1.0e-20f));
+        }
+
+        // rises at once and falls back gradually, so short peaks stay readable
+        levels[(size_t) point] = juce::jmax(target, levels[(size_t) point] - fallDecibelsPerTick);
+    }
+}
+
+//==============================================================================
+float SpectrumAnalyzer::frequencyToX(float frequency, float width) const noexcept
+{
+    auto maxFrequency = juce::jmin(20000.0f, (float) analysisRate * 0.5f);
+    return width * std::log(frequency / minFrequency) / std::log(maxFrequency / minFrequency);
+}
+
+void SpectrumAnalyzer::paint(juce::Graphics& g)
+{
+    auto bounds = getLocalBounds().toFloat();
+    g.setColour(juce::Colours::black.withAlpha(0.3f));
+    g.fillRect(bounds);
+
+    if (analysisRate <= 0.0) return;
+
+    g.setColour(juce::Colours::white.withAlpha(0.15f));
+    for (auto frequency : { 100.0f, 1000.0f, 10000.0f })
+        g.drawVerticalLine(juce::roundToInt(bounds.getX() + frequencyToX(frequency, bounds.getWidth())), bounds.getY(), bounds.getBottom());
+
+    // the points are log-spaced in frequency, so they are evenly spaced across the width
+    juce::Path spectrum;
+
+    for (int point = 0; point < numPoints; ++point)
+    {
+        auto x = bounds.getX() + bounds.getWidth() * (float) point / (float) (numPoints - 1);
+        auto y = juce::jmap(levels[(size_t) point], minDecibels, maxDecibels, bounds.getBottom(), bounds.getY());
+
+        if (point == 0) spectrum.startNewSubPath(x, y);
+        else            spectrum.lineTo(x, y);
+    }
+
+    g.setColour(juce::Colours::skyblue);
+    g.strokePath(spectrum, juce::PathStrokeType(1.5f));
+}
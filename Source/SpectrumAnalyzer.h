@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    SpectrumAnalyzer.h
+    Log-frequency spectrum of the processor's output, drawn on the message thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+//==============================================================================
+/**
+    The audio thread only copies a mono mix into the processor's SampleFifo. Everything else
+    happens here on a timer: high sample rates are decimated to about 48 kHz, frames overlap by
+    three quarters, and the most recent few frames are power-averaged into one spectrum per tick.
+
+    However far behind the timer falls, a tick never runs more than maxFramesPerTick FFTs and
+    skips whatever audio they wouldn't cover, so each open editor costs a bounded amount.
+*/
+class SpectrumAnalyzer : public juce::Component,
+                         private juce::Timer
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 4;
+    static constexpr int maxFramesPerTick = 4;
+    static constexpr int framesPerSecond = 30;
+    static constexpr int numPoints = 256;
+
+    static constexpr float minFrequency = 20.0f;
+    static constexpr float minDecibels = -96.0f, maxDecibels = 6.0f;
+    static constexpr float fallDecibelsPerTick = 1.5f;
+
+    explicit SpectrumAnalyzer(CombFilterBankAudioProcessor& p);
+    ~SpectrumAnalyzer() override;
+
+    void paint(juce::Graphics& g) override;
+
+private:
+    void timerCallback() override;
+    void configure(double sampleRate);
+    void addSample(float sample) noexcept;
+    void addFrame(int framesBack) noexcept;
+    void updateLevels(int numFrames) noexcept;
+
+    float frequencyToX(float frequency, float width) const noexcept;
+
+    CombFilterBankAudioProcessor& processor;
+
+    juce::dsp::FFT fft { fftOrder };
+    juce::dsp::WindowingFunction<float> window { (size_t) fftSize, juce::dsp::WindowingFunction<float>::hann, false };
+
+    // audio above the decimated Nyquist is filtered out before every decimationFactor-th sample is kept
+    double sampleRate = 0.0, analysisRate = 0.0;
+    int decimationFactor = 1, decimationPhase = 0;
+    juce::dsp::FIR::Filter<float> antiAliasFilter;
+
+    std::vector<float> incoming, history, fftData, powerSum;
+    int historyIndex = 0, samplesSinceFrame = 0, framesReady = 0;
+
+    std::array<float, numPoints> levels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumAnalyzer)
+};
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    TailTracker.h
+    Per-comb bound on how loud the delay lines can still be, for skipping silent blocks.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CombBank.h"
+
+//==============================================================================
+/**
+    The lines aren't measured. Each comb keeps an upper bound on the magnitude of everything in
+    its delay lines, worked out from the input peaks it was fed and the feedback it has decayed by:
+
+        every full delay, bound = inputPeak + feedback * bound
+        and it is never below inputPeak / (1 - feedback), where a steady input settles
+
+    and never above 1, since the saturator keeps the line inside [-1, 1].
+
+    What comes out of the line can still be louder than that. The damping filter and the thiran
+    allpass hold state from earlier, larger reads, which with low feedback can outlast the line
+    by a long way, and lagrange3 and thiran can overshoot the samples they blend. So the bank's
+    damping and interpolator state are read back each time: the state feeds back into the line,
+    so it goes into the bound, and the output is taken as the larger of the damping state and
+    the bound scaled by the interpolation's worst-case gain plus its state.
+
+    Combs whose level is 0 are tracked the same as the rest. Their lines keep ringing and would
+    be heard again as soon as the level came up.
+*/
+class TailTracker
+{
+public:
+    static constexpr float silenceThreshold = 1.0e-6f; // -120 dBFS
+
+    TailTracker() = default;
+
+    /** Call from prepareToPlay(), never while processing. */
+    void prepare(size_t numCombs)
+    {
+        combs.assign(numCombs, {});
+    }
+
+    /** After the bank's lines have been cleared. */
+    void reset() noexcept                   { std::fill(combs.begin(), combs.end(), Comb {}); }
+
+    /** After CombBank::resetComb(). With a fade the bank only clears the comb once its output has
+        faded out, and isRinging() covers that by counting any fade as ringing.
+    */
+    void resetComb(size_t comb) noexcept    { combs[comb] = {}; }
+
+    /** Call after the bank has processed a block whose input peaked at inputPeak. Inactive combs
+        aren't processed, so they hold whatever they had until they come back.
+    */
+    void addBlock(const CombBank& bank, float inputPeak, size_t numSamples) noexcept
+    {
+        for (size_t comb = 0; comb < combs.size(); ++comb)
+        {
+            if (! bank.isActive(comb)) continue;
+
+            auto& c = combs[comb];
+            auto feedback = bank.getMaxFeedback(comb);
+            auto delay = bank.getMaxDelay(comb);
+
+            if (feedback < 1.0f)
+                c.bound = juce::jmax(c.bound, inputPeak / (1.0f - feedback));
+            else if (inputPeak > 0.0f)
+                c.bound = 1.0f;
+
+            // a period that started in an earlier block may have seen a louder input than this one
+            c.periodPeak = juce::jmax(c.periodPeak, inputPeak);
+            c.samplesIntoPeriod += numSamples;
+
+            if (auto periods = c.samplesIntoPeriod / delay; periods > 0)
+            {
+                c.samplesIntoPeriod -= periods * delay;
+                c.bound = c.periodPeak + feedback * c.bound;
+
+                // any further whole periods lay inside this block, as a geometric series
+                if (periods > 1)
+                {
+                    auto decay = power(feedback, periods - 1);
+                    auto driven = feedback < 1.0f ? inputPeak * (1.0f - decay) / (1.0f - feedback)
+                                                  : inputPeak * (float) (periods - 1);
+                    c.bound = decay * c.bound + driven;
+                }
+
+                c.periodPeak = inputPeak;
+            }
+
+            // the damping filter only moves towards what the line gives it, so until it gets there
+            // its state is what goes back in
+            auto held = juce::jmax(bank.getDampingStatePeak(comb), bank.getTapStatePeak(comb));
+            c.bound = juce::jmin(juce::jmax(c.bound, inputPeak + feedback * held), 1.0f);
+        }
+    }
+
+    /** Whether any active comb could still be above silenceThreshold. An inactive one isn't heard,
+        and its bound is still there if it comes back.
+    */
+    bool isRinging(const CombBank& bank) const noexcept
+    {
+        // a comb fading out for a reset has had its bound dropped already, and fades only last a few blocks
+        if (bank.isRamping())
+            return true;
+
+        auto gain = FractionalDelay::getMaxGain(bank.getInterpolation());
+
+        for (size_t comb = 0; comb < combs.size(); ++comb)
+        {
+            if (! bank.isActive(comb)) continue;
+
+            auto output = juce::jmax(bank.getDampingStatePeak(comb), gain * combs[comb].bound + bank.getTapStatePeak(comb));
+            if (output > silenceThreshold)
+                return true;
+        }
+
+        return false;
+    }
+
+private:
+    // by squaring, since the audio thread calls this every tick and the exponent is small
+    static float power(float base, size_t exponent) noexcept
+    {
+        auto result = 1.0f;
+
+        for (; exponent > 0; exponent >>= 1, base *= base)
+            if ((exponent & 1) != 0)
+                result *= base;
+
+        return result;
+    }
+
+    struct Comb
+    {
+        float bound = 0.0f, periodPeak = 0.0f;
+        size_t samplesIntoPeriod = 0;
+    };
+
+    std::vector<Comb> combs;
+
+    JUCE_DECLARE_NON_COPYABLE(TailTracker)
+};
@@ -0,0 +1,210 @@
+/*
+  ==============================================================================
+
+    Tuning.cpp
+
+  ==============================================================================
+*/
+
+#include "Tuning.h"
+
+namespace
+{
+    // every line that isn't a comment, trimmed, in order
+    juce::StringArray getScalaLines(const juce::String& text)
+    {
+        juce::StringArray lines;
+
+        for (auto& line : juce::StringArray::fromLines(text))
+            if (! line.startsWithChar('!'))
+                lines.add(line.trim());
+
+        return lines;
+    }
+
+    // anything after the first word of a line is a comment
+    juce::String getFirstWord(const juce::String& line)
+    {
+        return line.trim().initialSectionNotContaining(" \t");
+    }
+
+    bool parseInteger(const juce::String& line, int& value)
+    {
+        auto word = getFirstWord(line);
+        if (word.isEmpty() || ! word.containsOnly("-0123456789")) return false;
+
+        value = word.getIntValue();
+        return true;
+    }
+
+    // a pitch with a decimal point is in cents, anything else is a ratio or a whole number
+    bool parsePitch(const juce::String& line, double& cents)
+    {
+        auto word = getFirstWord(line);
+        if (word.isEmpty() || ! word.containsOnly("-0123456789./")) return false;
+
+        if (word.containsChar('.'))
+        {
+            cents = word.getDoubleValue();
+            return true;
+        }
+
+        auto numerator = word.upToFirstOccurrenceOf("/", false, false).getDoubleValue();
+        auto denominator = word.containsChar('/') ? word.fromFirstOccurrenceOf("/", false, false).getDoubleValue() : 1.0;
+        if (numerator <= 0.0 || denominator <= 0.0) return false;
+
+        cents = 1200.0 * std::log2(numerator / denominator);
+        return true;
+    }
+
+    // rounding towards minus infinity, so keys and degrees below the reference wrap the right way
+    int floorDivide(int value, int divisor) noexcept
+    {
+        return value / divisor - (value % divisor != 0 && (value < 0) != (divisor < 0) ? 1 : 0);
+    }
+
+    int floorModulo(int value, int divisor) noexcept
+    {
+        return value - floorDivide(value, divisor) * divisor;
+    }
+}
+
+//==============================================================================
+Tuning::Tuning() : name("12-TET")
+{
+    for (int note = 0; note < numMidiNotes; ++note)
+        frequencies[(size_t) note] = EqualTemperament::contains(note)
+                                   ? EqualTemperament::getFrequency(note)
+                                   : EqualTemperament::referenceHz * std::pow(2.0, (note - EqualTemperament::referenceNote) / 12.0);
+}
+
+juce::Result Tuning::loadScala(const juce::String& scale, const juce::String& keyboardMapping)
+{
+    // the description comes first even when it is blank, then the number of notes, then the notes
+    auto lines = getScalaLines(scale);
+    auto numDegrees = 0;
+
+    if (lines.size() < 2 || ! parseInteger(lines[1], numDegrees) || numDegrees < 1)
+        return juce::Result::fail("The scale doesn't say how many notes it has");
+
+    // degree 0 is the unison, which the file leaves out, and the last note is the period
+    std::vector<double> cents { 0.0 };
+
+    for (int i = 2; i < lines.size() && (int) cents.size() <= numDegrees; ++i)
+    {
+        if (lines[i].isEmpty()) continue;
+
+        auto pitch = 0.0;
+        if (! parsePitch(lines[i], pitch))
+            return juce::Result::fail("The scale has a note that isn't a pitch: " + lines[i]);
+
+        cents.push_back(pitch);
+    }
+
+    if ((int) cents.size() <= numDegrees)
+        return juce::Result::fail("The scale lists fewer notes than it says it has");
+
+    auto period = cents.back();
+    if (period <= 0.0)
+        return juce::Result::fail("The scale's last note has to be above its first");
+
+    // a linear mapping with degree 0 on middle C, unless the keyboard mapping says otherwise
+    auto mapSize = 0, firstNote = 0, lastNote = numMidiNotes - 1, middleNote = 60, referenceNote = 60;
+    auto octaveDegree = numDegrees;
+    auto referenceHz = EqualTemperament::getFrequency(60);
+    std::vector<int> mapping; // -1 for a key left out
+
+    if (keyboardMapping.isNotEmpty())
+    {
+        auto map = getScalaLines(keyboardMapping);
+        map.removeEmptyStrings();
+
+        // the first five lines and the seventh are whole numbers, the sixth the reference frequency
+        int header[6] = {};
+        auto headerIsComplete = map.size() >= 7;
+
+        for (int i = 0; i < 6 && headerIsComplete; ++i)
+            headerIsComplete = parseInteger(map[i < 5 ? i : 6], header[i]);
+
+        if (! headerIsComplete || header[0] < 0 || header[5] < 0)
+            return juce::Result::fail("The keyboard mapping's header is incomplete");
+
+        mapSize = header[0];
+        firstNote = header[1];
+        lastNote = header[2];
+        middleNote = header[3];
+        referenceNote = header[4];
+        octaveDegree = header[5];
+
+        referenceHz = getFirstWord(map[5]).getDoubleValue();
+        if (referenceHz <= 0.0)
+            return juce::Result::fail("The keyboard mapping has no reference frequency");
+
+        if (map.size() < 7 + mapSize)
+            return juce::Result::fail("The keyboard mapping lists fewer keys than it says it has");
+
+        for (int i = 0; i < mapSize; ++i)
+        {
+            auto word = getFirstWord(map[7 + i]);
+            auto degree = -1;
+
+            if (! word.equalsIgnoreCase("x") && (! parseInteger(word, degree) || degree < 0))
+                return juce::Result::fail("The keyboard mapping has a key that isn't a scale degree: " + word);
+
+            mapping.push_back(degree);
+        }
+
+        // the scale's own period when the mapping doesn't name one
+        if (octaveDegree == 0)
+            octaveDegree = numDegrees;
+    }
+
+    auto getDegree = [&](int note, int& degree)
+    {
+        auto offset = note - middleNote;
+        if (mapping.empty())
+        {
+            degree = offset;
+            return true;
+        }
+
+        auto key = mapping[(size_t) floorModulo(offset, mapSize)];
+        degree = key + floorDivide(offset, mapSize) * octaveDegree;
+        return key >= 0;
+    };
+
+    auto getCents = [&](int degree)
+    {
+        return floorDivide(degree, numDegrees) * period + cents[(size_t) floorModulo(degree, numDegrees)];
+    };
+
+    auto referenceDegree = 0;
+    if (! getDegree(referenceNote, referenceDegree))
+        return juce::Result::fail("The keyboard mapping leaves its reference key out");
+
+    auto referenceCents = getCents(referenceDegree);
+
+    for (int note = 0; note < numMidiNotes; ++note)
+    {
+        auto degree = 0;
+        auto mapped = note >= firstNote && note <= lastNote && getDegree(note, degree);
+        frequencies[(size_t) note] = mapped ? referenceHz * std::pow(2.0, (getCents(degree) - referenceCents) / 1200.0) : 0.0;
+    }
+
+    name = lines[0].isNotEmpty() ? lines[0] : "Scala scale";
+    scaleText = scale;
+    mappingText = keyboardMapping;
+    return juce::Result::ok();
+}
+
+//==============================================================================
+void NoteDelayMap::build(const Tuning& tuning, double sampleRate, float minPitchHz, float maxPitchHz) noexcept
+{
+    for (int note = 0; note < Tuning::numMidiNotes; ++note)
+    {
+        auto pitch = tuning.isMapped(note) ? juce::jlimit(minPitchHz, maxPitchHz, (float) tuning.getFrequency(note)) : 0.0f;
+
+        pitches[(size_t) note] = pitch;
+        delays[(size_t) note] = pitch > 0.0f ? (float) (sampleRate / (double) pitch) : 0.0f;
+    }
+}
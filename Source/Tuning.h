@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    Tuning.h
+    Which frequency each note plays: equal temperament worked out by the compiler, or a Scala
+    microtuning, and the comb delays either one comes to at a given sample rate.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Twelve-tone equal temperament at A4 = 440 Hz, over the notes a comb can play from C0 to C9.
+    The table is built at compile time: the twelve notes up from A4 by repeated semitones, and
+    every other octave from those by exact factors of two.
+*/
+struct EqualTemperament
+{
+    static constexpr int lowestNote = 12;   // C0
+    static constexpr int highestNote = 120; // C9
+    static constexpr int numNotes = highestNote - lowestNote + 1;
+
+    static constexpr int referenceNote = 69; // A4
+    static constexpr double referenceHz = 440.0;
+
+    static constexpr std::array<double, numNotes> frequencies = []
+    {
+        constexpr double semitone = 1.0594630943592952646; // 2^(1/12)
+
+        std::array<double, 12> steps {};
+        steps[0] = 1.0;
+        for (size_t step = 1; step < steps.size(); ++step)
+            steps[step] = steps[step - 1] * semitone;
+
+        std::array<double, numNotes> table {};
+
+        for (int note = lowestNote; note <= highestNote; ++note)
+        {
+            auto offset = note - referenceNote;
+            auto octave = (offset >= 0 ? offset : offset - 11) / 12;
+            auto hz = referenceHz * steps[(size_t) (offset - octave * 12)];
+
+            for (; octave > 0; --octave) hz *= 2.0;
+            for (; octave < 0; ++octave) hz *= 0.5;
+
+            table[(size_t) (note - lowestNote)] = hz;
+        }
+
+        return table;
+    }();
+
+    static constexpr bool contains(int note) noexcept { return note >= lowestNote && note <= highestNote; }
+
+    static constexpr double getFrequency(int note) noexcept
+    {
+        return frequencies[(size_t) (note < lowestNote ? lowestNote : note > highestNote ? highestNote : note) - lowestNote];
+    }
+
+    /** Scientific pitch notation, with middle C (60) as C4. */
+    static juce::String getNoteName(int note)
+    {
+        constexpr const char* names[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+        return juce::String(names[note % 12]) + juce::String(note / 12 - 1);
+    }
+};
+
+static_assert(EqualTemperament::getFrequency(EqualTemperament::referenceNote) == EqualTemperament::referenceHz);
+static_assert(EqualTemperament::getFrequency(81) == 880.0);
+
+//==============================================================================
+/**
+    A frequency for every MIDI note, either equal temperament or a Scala scale (.scl) laid out
+    over the keyboard by an optional Scala keyboard mapping (.kbm). Loading does all the parsing
+    and pow() on the calling thread, which is never the audio thread.
+
+    Without a mapping, scale degree 0 sits on middle C at its equal-tempered pitch and each key
+    up is one degree up. Keys a mapping leaves out, marked x, aren't mapped and play nothing new.
+*/
+class Tuning
+{
+public:
+    static constexpr int numMidiNotes = 128;
+
+    /** Equal temperament. */
+    Tuning();
+
+    /** Replaces the tuning with a scale and an optional keyboard mapping, given as the text of the
+        files. On failure the tuning is left as it was and the result says what was wrong.
+    */
+    juce::Result loadScala(const juce::String& scale, const juce::String& keyboardMapping = {});
+
+    bool isMapped(int note) const noexcept { return juce::isPositiveAndBelow(note, numMidiNotes) && frequencies[(size_t) note] > 0.0; }
+
+    /** Zero for a key the mapping leaves out. */
+    double getFrequency(int note) const noexcept { return isMapped(note) ? frequencies[(size_t) note] : 0.0; }
+
+    /** The scale's description line, or 12-TET. */
+    const juce::String& getName() const noexcept { return name; }
+
+    /** The text the tuning was loaded from, so it can be saved with the session. Both are empty for
+        equal temperament.
+    */
+    const juce::String& getScale() const noexcept { return scaleText; }
+    const juce::String& getKeyboardMapping() const noexcept { return mappingText; }
+    bool isEqualTemperament() const noexcept { return scaleText.isEmpty(); }
+
+private:
+    std::array<double, numMidiNotes> frequencies;
+    juce::String name, scaleText, mappingText;
+};
+
+//==============================================================================
+/**
+    One tuning at one sample rate: the pitch and comb delay of every MIDI note, worked out once so
+    that retuning a comb, or the whole bank, is a lookup. A fixed size, so building one allocates
+    nothing and the processor can keep a few to swap between threads.
+*/
+class NoteDelayMap
+{
+public:
+    /** Pitches are clamped to what a comb can play, as the pitch parameter's are. */
+    void build(const Tuning& tuning, double sampleRate, float minPitchHz, float maxPitchHz) noexcept;
+
+    bool isMapped(int note) const noexcept { return juce::isPositiveAndBelow(note, Tuning::numMidiNotes) && delays[(size_t) note] > 0.0f; }
+
+    /** In samples and fractions of one, for CombBank::glideDelay(). Zero for a note that isn't mapped. */
+    float getDelay(int note) const noexcept { return delays[(size_t) note]; }
+    float getPitch(int note) const noexcept { return pitches[(size_t) note]; }
+
+private:
+    std::array<float, Tuning::numMidiNotes> delays {}, pitches {};
+};
@@ -0,0 +1,196 @@
+/*
+  ==============================================================================
+
+    VoiceAllocator.h
+    Hands MIDI notes out to combs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    Keeps track of which voice, here a comb, is playing which note, and picks one for each new note:
+
+        roundRobin  the voices in turn, skipping any still held, so each one rings out for as long
+                    as it can before it is used again
+        oldest      the voice released longest ago
+
+    Once every voice is held both modes steal one, roundRobin the next in turn and oldest the note
+    held longest. A note played again goes back to the voice that last played it, which is already
+    tuned and may still be ringing. Voices released while the sustain pedal is down carry on until
+    it comes up.
+
+    Fixed size after prepare(), so nothing allocates on the audio thread.
+*/
+class VoiceAllocator
+{
+public:
+    enum class Mode
+    {
+        roundRobin,
+        oldest
+    };
+
+    void prepare(size_t numVoices)
+    {
+        voices.assign(numVoices, {});
+        reset();
+    }
+
+    /** Forgets every note, without releasing anything. */
+    void reset() noexcept
+    {
+        std::fill(voices.begin(), voices.end(), Voice {});
+        nextVoice = 0;
+        clock = 0;
+        sustainDown = false;
+    }
+
+    void setMode(Mode newMode) noexcept { mode = newMode; }
+    Mode getMode() const noexcept { return mode; }
+
+    /** Picks a voice for the note from those canUse(voice) allows, and marks it held. Returns -1 if
+        there is none to use.
+    */
+    template <typename CanUse>
+    int noteOn(int note, CanUse&& canUse) noexcept
+    {
+        auto chosen = findVoice(note, canUse);
+        if (chosen < 0) return -1;
+
+        voices[(size_t) chosen] = { note, State::held, ++clock };
+        nextVoice = ((size_t) chosen + 1) % voices.size();
+        return chosen;
+    }
+
+    /** Returns the voice to release, or -1 if the note isn't held or the pedal is keeping it. */
+    int noteOff(int note) noexcept
+    {
+        for (size_t voice = 0; voice < voices.size(); ++voice)
+        {
+            auto& v = voices[voice];
+            if (v.state != State::held || v.note != note) continue;
+
+            if (sustainDown)
+            {
+                v.state = State::sustained;
+                return -1;
+            }
+
+            releaseVoice(voice);
+            return (int) voice;
+        }
+
+        return -1;
+    }
+
+    /** Lifting the pedal calls release(voice) for every voice it was keeping. */
+    template <typename Release>
+    void setSustain(bool isDown, Release&& release) noexcept
+    {
+        sustainDown = isDown;
+        if (isDown) return;
+
+        for (size_t voice = 0; voice < voices.size(); ++voice)
+        {
+            if (voices[voice].state != State::sustained) continue;
+
+            releaseVoice(voice);
+            release(voice);
+        }
+    }
+
+    /** Calls release(voice) for every voice still sounding, pedal or not. */
+    template <typename Release>
+    void releaseAll(Release&& release) noexcept
+    {
+        for (size_t voice = 0; voice < voices.size(); ++voice)
+        {
+            if (! isSounding(voices[voice])) continue;
+
+            releaseVoice(voice);
+            release(voice);
+        }
+    }
+
+private:
+    enum class State
+    {
+        idle,       // hasn't played a note yet
+        held,
+        sustained,  // released, but the pedal is down
+        released
+    };
+
+    // age is when the note started while it sounds, and when it was released after that
+    struct Voice
+    {
+        int note = -1;
+        State state = State::idle;
+        juce::uint64 age = 0;
+    };
+
+    static bool isSounding(const Voice& v) noexcept { return v.state == State::held || v.state == State::sustained; }
+
+    void releaseVoice(size_t voice) noexcept
+    {
+        voices[voice].state = State::released;
+        voices[voice].age = ++clock;
+    }
+
+    template <typename CanUse>
+    int findVoice(int note, CanUse& canUse) const noexcept
+    {
+        if (voices.empty()) return -1;
+
+        for (size_t voice = 0; voice < voices.size(); ++voice)
+            if (voices[voice].state != State::idle && voices[voice].note == note && canUse(voice))
+                return (int) voice;
+
+        auto best = -1;
+
+        if (mode == Mode::roundRobin)
+        {
+            for (size_t step = 0; step < voices.size(); ++step)
+            {
+                auto voice = (nextVoice + step) % voices.size();
+                if (! canUse(voice)) continue;
+                if (! isSounding(voices[voice])) return (int) voice;
+
+                if (best < 0) best = (int) voice;
+            }
+
+            return best;
+        }
+
+        // anything silent beats anything sounding, and then the older the better. An idle voice is
+        // age 0, so it goes before any that has been released
+        for (size_t voice = 0; voice < voices.size(); ++voice)
+        {
+            if (! canUse(voice)) continue;
+
+            auto& v = voices[voice];
+            if (best < 0)
+            {
+                best = (int) voice;
+                continue;
+            }
+
+            auto& b = voices[(size_t) best];
+            if (isSounding(v) == isSounding(b) ? v.age < b.age : isSounding(b))
+                best = (int) voice;
+        }
+
+        return best;
+    }
+
+    std::vector<Voice> voices;
+    Mode mode = Mode::roundRobin;
+    size_t nextVoice = 0;
+    juce::uint64 clock = 0;
+    bool sustainDown = false;
+};
@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+    WorkerPool.cpp
+
+  ==============================================================================
+*/
+
+#include "WorkerPool.h"
+#include "RealtimeGuard.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+namespace
+{
+    // tells the core we're in a spin loop, so a hyperthreaded sibling gets the pipeline meanwhile
+    inline void spinPause() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #endif
+    }
+}
+
+//==============================================================================
+class WorkerPool::Worker : public juce::Thread
+{
+public:
+    Worker(WorkerPool& p, size_t partitionIndex, uint32_t firstGeneration)
+        : juce::Thread("Comb worker " + juce::String((int) partitionIndex)),
+          pool(p),
+          partition(partitionIndex),
+          generation(firstGeneration)
+    {
+    }
+
+    void run() override { pool.work(partition, generation); }
+
+private:
+    WorkerPool& pool;
+    size_t partition;
+    uint32_t generation;
+};
+
+//==============================================================================
+WorkerPool::WorkerPool() = default;
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::start(size_t numWorkers)
+{
+    stop();
+    stopping = false;
+
+    // taken until the first dispatch, so nothing runs before there is a job
+    claims = std::make_unique<Claim[]>(numWorkers);
+
+    for (size_t i = 0; i < numWorkers; ++i)
+    {
+        // the generation is taken here rather than when the thread gets going, so a dispatch
+        // that beats the thread to its first wait isn't missed
+        auto* worker = workers.add(new Worker(*this, i + 1, generation.load()));
+
+        // the highest priority JUCE offers, which it maps to a real-time policy where the OS allows one
+        worker->startThread(10);
+    }
+}
+
+void WorkerPool::stop()
+{
+    if (workers.isEmpty()) return;
+
+    stopping = true;
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    for (auto* worker : workers)
+        worker->stopThread(1000);
+
+    workers.clear();
+}
+
+void WorkerPool::dispatch() noexcept
+{
+    auto numWorkers = (size_t) workers.size();
+
+    // pending is set before any claim opens, so a worker that is still awake from the last
+    // dispatch can't count itself out of this one too early
+    pending.store((uint32_t) numWorkers, std::memory_order_relaxed);
+
+    for (size_t i = 0; i < numWorkers; ++i)
+        claims[i].taken.store(false, std::memory_order_release);
+
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    trampoline(context, 0);
+
+    // the caller's share is as big as anyone's, so a worker that hasn't started its own by now
+    // is still waking or has been descheduled, and the caller runs it rather than wait
+    for (size_t i = 0; i < numWorkers; ++i)
+    {
+        if (claims[i].taken.exchange(true, std::memory_order_acq_rel)) continue;
+
+        trampoline(context, i + 1);
+        pending.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // only partitions already underway are left, so this rarely spins for long
+    while (pending.load(std::memory_order_acquire) != 0)
+        spinPause();
+}
+
+void WorkerPool::work(size_t partition, uint32_t seen) noexcept
+{
+    for (;;)
+    {
+        // blocks arrive every millisecond or so, so spin before paying for a futex sleep and wake
+        for (int i = 0; i < spinIterations && generation.load(std::memory_order_acquire) == seen; ++i)
+            spinPause();
+
+        generation.wait(seen, std::memory_order_acquire);
+        seen = generation.load(std::memory_order_acquire);
+
+        if (stopping.load(std::memory_order_acquire))
+            return;
+
+        // the caller got here first and ran it. A worker that slept through a whole dispatch may
+        // find the next one's claim open instead, which is just as good
+        if (claims[partition - 1].taken.exchange(true, std::memory_order_acq_rel))
+            continue;
+
+        {
+            // a worker's share of the block is held to the same rules as the audio thread's
+            RealtimeGuard::ScopedAudioCallback realtimeGuard;
+            trampoline(context, partition);
+        }
+
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+}
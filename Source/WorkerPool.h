@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    WorkerPool.h
+    Fixed set of high-priority threads that share the audio callback's work.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+    run() hands the same job to every worker and to the calling thread, one partition each,
+    and returns once all of them have finished. Nothing locks or allocates on the way: the
+    caller bumps a generation counter, the workers spin on it for a short while and then sleep
+    on it with a futex wait, and each one counts itself out on a second atomic that the
+    caller spins on.
+
+    Each partition is claimed before it runs. Once the caller has finished its own partition it
+    claims and runs any a worker hasn't picked up yet, so a worker the OS has descheduled can't
+    hold the audio callback up for a scheduler quantum. Only a worker that has already started
+    its partition is waited for.
+
+    start() and stop() create and join the threads, so call them from prepareToPlay() and
+    releaseResources() rather than the audio thread.
+*/
+class WorkerPool
+{
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    /** Restarts the pool with this many threads besides the caller's own. Zero stops it. */
+    void start(size_t numWorkers);
+    void stop();
+
+    size_t getNumWorkers() const noexcept { return (size_t) workers.size(); }
+
+    /** Partition 0 always runs on the calling thread, the workers take 1 to getNumWorkers(). */
+    size_t getNumPartitions() const noexcept { return getNumWorkers() + 1; }
+
+    template <typename Job>
+    void run(Job& job) noexcept
+    {
+        if (workers.isEmpty())
+        {
+            job((size_t) 0);
+            return;
+        }
+
+        // a plain function pointer and context, so the handoff needs no std::function
+        context = &job;
+        trampoline = [](void* c, size_t partition) { (*static_cast<Job*>(c))(partition); };
+
+        dispatch();
+    }
+
+private:
+    class Worker;
+
+    void dispatch() noexcept;
+    void work(size_t partition, uint32_t seen) noexcept;
+
+    // how long a worker spins before sleeping, about one 64-sample block at 48 kHz
+    static constexpr int spinIterations = 4000;
+
+    juce::OwnedArray<Worker> workers;
+
+    void* context = nullptr;
+    void (*trampoline)(void*, size_t) = nullptr;
+
+    // one flag per worker's partition, cleared by each dispatch and set by whoever runs it
+    struct alignas(64) Claim
+    {
+        std::atomic<bool> taken { true };
+    };
+
+    std::unique_ptr<Claim[]> claims;
+
+    // generation counts dispatches, pending counts partitions that haven't finished the current one
+    alignas(64) std::atomic<uint32_t> generation { 0 };
+    alignas(64) std::atomic<uint32_t> pending { 0 };
+    std::atomic<bool> stopping { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WorkerPool)
+};
@@ -0,0 +1,275 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Console checks for the CombFilterBank sources. Exits non-zero if any of them fail.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PartitionedConvolution.h"
+#include "../../Source/Tuning.h"
+
+//==============================================================================
+namespace
+{
+    constexpr double tolerance = 1.0e-6; // relative, well under a thousandth of a cent
+
+    // a four-note scale with one pitch of each kind, and comments wherever Scala allows them
+    const char* const mixedScale = R"(! mixed.scl
+!
+Mixed pitches
+ 4
+! cents, a ratio, a ratio with a comment after it, and a whole number
+ 100.0
+ 5/4
+ 3/2 a fifth
+ 2
+)";
+
+    double ratioFromCents(double cents)
+    {
+        return std::pow(2.0, cents / 1200.0);
+    }
+}
+
+//==============================================================================
+class TuningTests : public juce::UnitTest
+{
+public:
+    TuningTests() : juce::UnitTest("Tuning", "CombFilterBank") {}
+
+    void runTest() override
+    {
+        beginTest("Equal temperament");
+        {
+            Tuning tuning;
+            expect(tuning.isEqualTemperament());
+            expectEquals(tuning.getFrequency(69), 440.0);
+            expectEquals(tuning.getFrequency(57), 220.0);
+            expectRatio(tuning.getFrequency(60), 440.0 * ratioFromCents(-900.0));
+        }
+
+        beginTest("Cents, ratio and whole number lines");
+        {
+            Tuning tuning;
+            expectOk(tuning.loadScala(mixedScale));
+            expectEquals(tuning.getName(), juce::String("Mixed pitches"));
+
+            // with no mapping degree 0 sits on middle C at its equal-tempered pitch
+            auto middleC = EqualTemperament::getFrequency(60);
+            expectRatio(tuning.getFrequency(60), middleC);
+            expectRatio(tuning.getFrequency(61), middleC * ratioFromCents(100.0));
+            expectRatio(tuning.getFrequency(62), middleC * 5.0 / 4.0);
+            expectRatio(tuning.getFrequency(63), middleC * 3.0 / 2.0);
+            expectRatio(tuning.getFrequency(64), middleC * 2.0);
+
+            // below the reference the degrees wrap down a period
+            expectRatio(tuning.getFrequency(59), middleC * 3.0 / 4.0);
+            expectRatio(tuning.getFrequency(56), middleC / 2.0);
+        }
+
+        beginTest("Keyboard mapping with keys left out");
+        {
+            Tuning tuning;
+            expectOk(tuning.loadScala(mixedScale, R"(! holes.kbm
+! size, first and last key, middle key, reference key, its frequency, period degree
+4
+0
+127
+60
+60
+300.0
+4
+! the keys, with the second left out
+0
+x
+2
+3
+)"));
+
+            expectRatio(tuning.getFrequency(60), 300.0);
+            expect(! tuning.isMapped(61));
+            expectEquals(tuning.getFrequency(61), 0.0);
+            expectRatio(tuning.getFrequency(62), 300.0 * 5.0 / 4.0);
+            expectRatio(tuning.getFrequency(63), 300.0 * 3.0 / 2.0);
+            expectRatio(tuning.getFrequency(64), 600.0);
+            expect(! tuning.isMapped(65));
+            expectRatio(tuning.getFrequency(56), 150.0);
+        }
+
+        beginTest("Keyboard mapping of size 0 is linear");
+        {
+            Tuning tuning;
+            expectOk(tuning.loadScala(mixedScale, R"(0
+0
+127
+60
+69
+440.0
+0
+)"));
+
+            // key 69 is degree 9, two periods and a degree up from middle C, and pinned to 440
+            expectRatio(tuning.getFrequency(69), 440.0);
+            expectRatio(tuning.getFrequency(70), 440.0 * (5.0 / 4.0) / ratioFromCents(100.0));
+            expectRatio(tuning.getFrequency(73), 880.0);
+            expectRatio(tuning.getFrequency(60), 440.0 / 4.0 / ratioFromCents(100.0));
+        }
+
+        beginTest("A scale that fails to load leaves the tuning alone");
+        {
+            Tuning tuning;
+            expect(tuning.loadScala("Too short\n 3\n 100.0\n 2/1\n").failed());
+            expect(tuning.loadScala("No count\n").failed());
+            expect(tuning.loadScala(mixedScale, "1\n0\n127\n60\n60\n440.0\n4\n y\n").failed());
+            expect(tuning.isEqualTemperament());
+            expectEquals(tuning.getFrequency(69), 440.0);
+        }
+
+        beginTest("Note delays");
+        {
+            // CombBank's and the pitch parameter's limits, C0 to C9, without pulling in either
+            constexpr float minPitchHz = 16.35f, maxPitchHz = 8372.02f;
+
+            Tuning tuning;
+            NoteDelayMap map;
+            map.build(tuning, 48000.0, minPitchHz, maxPitchHz);
+
+            expect(map.isMapped(69));
+            expectWithinAbsoluteError(map.getDelay(69), 48000.0f / 440.0f, 1.0e-4f);
+            expectWithinAbsoluteError(map.getPitch(69), 440.0f, 1.0e-4f);
+
+            // pitches out of a comb's range are clamped, as the pitch parameter's are
+            expectWithinAbsoluteError(map.getDelay(0), 48000.0f / minPitchHz, 1.0e-3f);
+            expectWithinAbsoluteError(map.getPitch(127), maxPitchHz, 1.0e-3f);
+
+            expectOk(tuning.loadScala(mixedScale, "4\n0\n127\n60\n60\n300.0\n4\n0\nx\n2\n3\n"));
+            map.build(tuning, 48000.0, minPitchHz, maxPitchHz);
+
+            expectWithinAbsoluteError(map.getDelay(60), 160.0f, 1.0e-4f);
+            expect(! map.isMapped(61));
+            expectEquals(map.getDelay(61), 0.0f);
+        }
+    }
+
+private:
+    void expectOk(const juce::Result& result)
+    {
+        expect(result.wasOk(), result.getErrorMessage());
+    }
+
+    void expectRatio(double actual, double expected)
+    {
+        expectWithinAbsoluteError(actual / expected, 1.0, tolerance,
+                                  juce::String(actual, 6) + " Hz where " + juce::String(expected, 6) + " Hz was expected");
+    }
+};
+
+static TuningTests tuningTests;
+
+//==============================================================================
+class PartitionedConvolutionTests : public juce::UnitTest
+{
+public:
+    PartitionedConvolutionTests() : juce::UnitTest("PartitionedConvolution", "CombFilterBank") {}
+
+    void runTest() override
+    {
+        constexpr auto shortSize = PartitionedConvolution::shortPartitionSize;
+
+        // inside the head, past it, past the first short partition, at and past the first long
+        // partition, and a few more long ones
+        beginTest("Against direct convolution, with calls of 1 to 32 samples");
+        {
+            for (auto length : { (size_t) 1, shortSize - 1, shortSize, shortSize + 1, 2 * shortSize + 7,
+                                 partitionSize - 1, partitionSize, partitionSize + 1, 3 * partitionSize + 333 })
+                checkAgainstDirect(length);
+
+            for (int i = 0; i < 6; ++i)
+                checkAgainstDirect((size_t) getRandom().nextInt({ 1, (int) (maxPartitions * partitionSize) }));
+        }
+    }
+
+private:
+    static constexpr size_t partitionSize = 1024, maxPartitions = 4, numChannels = 2;
+
+    // the input plays for a while and then stops, so the last stretch is the ring-out of a null input
+    void checkAgainstDirect(size_t length)
+    {
+        auto& random = getRandom();
+        auto numSamples = length + 2 * partitionSize + (size_t) random.nextInt(3000);
+        auto inputEnd = numSamples - length - partitionSize / 2;
+
+        std::vector<float> impulse(length);
+        for (auto& tap : impulse)
+            tap = (random.nextFloat() * 2.0f - 1.0f) / std::sqrt((float) length);
+
+        juce::AudioBuffer<float> input((int) numChannels, (int) numSamples), output((int) numChannels, (int) numSamples);
+        output.clear();
+
+        for (int ch = 0; ch < (int) numChannels; ++ch)
+            for (int i = 0; i < (int) numSamples; ++i)
+                input.setSample(ch, i, i < (int) inputEnd ? random.nextFloat() * 2.0f - 1.0f : 0.0f);
+
+        PartitionedConvolution::Impulse transformed;
+        transformed.allocate(partitionSize, maxPartitions);
+        expect(transformed.set(impulse.data(), length));
+
+        PartitionedConvolution convolution;
+        convolution.prepare(partitionSize, maxPartitions, numChannels);
+        convolution.reset(transformed.getNumPartitions());
+
+        for (size_t done = 0; done < numSamples;)
+        {
+            auto n = juce::jmin(numSamples - done, (size_t) random.nextInt({ 1, 33 }));
+
+            const float* in[numChannels];
+            float* out[numChannels];
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                in[ch] = input.getReadPointer((int) ch, (int) done);
+                out[ch] = output.getWritePointer((int) ch, (int) done);
+            }
+
+            convolution.process(transformed, done < inputEnd ? in : nullptr, out, numChannels, n);
+            done += n;
+        }
+
+        auto maxError = 0.0;
+        for (int ch = 0; ch < (int) numChannels; ++ch)
+        {
+            auto* x = input.getReadPointer(ch);
+
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                auto expected = 0.0;
+                for (size_t k = 0; k < juce::jmin(length, i + 1); ++k)
+                    expected += (double) impulse[k] * (double) x[i - k];
+
+                maxError = juce::jmax(maxError, std::abs(expected - (double) output.getSample(ch, (int) i)));
+            }
+        }
+
+        // the taps are scaled so the output stays around the input's level, where float rounding
+        // through the transforms is a few parts in a million
+        expectLessThan(maxError, 1.0e-4, "with an impulse of " + juce::String(length) + " samples");
+    }
+};
+
+static PartitionedConvolutionTests partitionedConvolutionTests;
+
+//==============================================================================
+int main()
+{
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("CombFilterBank");
+
+    auto failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+
+    return failures > 0 ? 1 : 0;
+}